@@ -41,10 +41,20 @@ __subsystem struct behavior_driver_api {
     behavior_keymap_binding_callback_t binding_released;
     behavior_sensor_keymap_binding_callback_t sensor_binding_triggered;
 };
+
 /**
  * @endcond
  */
 
+/**
+ * @brief Like DEVICE_DT_INST_DEFINE, but also checks that the instance's compatible is listed in
+ * ZMK_BEHAVIOR_FOREACH, so it has a local ID and can be looked up by it.
+ */
+#define BEHAVIOR_DT_INST_DEFINE(inst, ...)                                                         \
+    BUILD_ASSERT(ZMK_BEHAVIOR_LOCAL_ID(DT_DRV_INST(inst)) != ZMK_BEHAVIOR_LOCAL_ID_NONE,           \
+                 "Behavior has no local ID");                                                      \
+    DEVICE_DT_INST_DEFINE(inst, __VA_ARGS__)
+
 /**
  * @brief Handle the keymap binding which needs to be converted from relative "toggle" to absolute
  * "turn on"
@@ -57,9 +67,24 @@ __subsystem struct behavior_driver_api {
 __syscall int behavior_keymap_binding_convert_central_state_dependent_params(
     struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event);
 
-static inline int z_impl_behavior_keymap_binding_convert_central_state_dependent_params(
-    struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+/**
+ * @brief Same as behavior_keymap_binding_convert_central_state_dependent_params, for a behavior
+ * device that has already been looked up
+ * @param dev Pointer to the device structure for the binding's behavior.
+ * @param binding Pointer to the details so of the binding
+ * @param event The event that triggered use of the binding
+ *
+ * @retval 0 If successful.
+ * @retval Negative errno code if failure.
+ */
+static inline int
+behavior_device_convert_central_state_dependent_params(const struct device *dev,
+                                                       struct zmk_behavior_binding *binding,
+                                                       struct zmk_behavior_binding_event event) {
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+
     const struct behavior_driver_api *api = (const struct behavior_driver_api *)dev->api;
 
     if (api->binding_convert_central_state_dependent_params == NULL) {
@@ -69,6 +94,13 @@ static inline int z_impl_behavior_keymap_binding_convert_central_state_dependent
     return api->binding_convert_central_state_dependent_params(binding, event);
 }
 
+static inline int z_impl_behavior_keymap_binding_convert_central_state_dependent_params(
+    struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event) {
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+
+    return behavior_device_convert_central_state_dependent_params(dev, binding, event);
+}
+
 /**
  * @brief Determine where the behavior should be run
  * @param behavior Pointer to the device structure for the driver instance.
@@ -103,10 +135,17 @@ static inline int z_impl_behavior_get_locality(const struct device *behavior,
 __syscall int behavior_keymap_binding_pressed(struct zmk_behavior_binding *binding,
                                               struct zmk_behavior_binding_event event);
 
-static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_binding *binding,
-                                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
-
+/**
+ * @brief Same as behavior_keymap_binding_pressed, for a behavior device that has already been
+ * looked up
+ * @param dev Pointer to the device structure for the binding's behavior.
+ *
+ * @retval 0 If successful.
+ * @retval Negative errno code if failure.
+ */
+static inline int behavior_device_binding_pressed(const struct device *dev,
+                                                  struct zmk_behavior_binding *binding,
+                                                  struct zmk_behavior_binding_event event) {
     if (dev == NULL) {
         return -EINVAL;
     }
@@ -120,6 +159,13 @@ static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_bin
     return api->binding_pressed(binding, event);
 }
 
+static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                                         struct zmk_behavior_binding_event event) {
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+
+    return behavior_device_binding_pressed(dev, binding, event);
+}
+
 /**
  * @brief Handle the assigned position being pressed
  * @param dev Pointer to the device structure for the driver instance.
@@ -131,10 +177,17 @@ static inline int z_impl_behavior_keymap_binding_pressed(struct zmk_behavior_bin
 __syscall int behavior_keymap_binding_released(struct zmk_behavior_binding *binding,
                                                struct zmk_behavior_binding_event event);
 
-static inline int z_impl_behavior_keymap_binding_released(struct zmk_behavior_binding *binding,
-                                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
-
+/**
+ * @brief Same as behavior_keymap_binding_released, for a behavior device that has already been
+ * looked up
+ * @param dev Pointer to the device structure for the binding's behavior.
+ *
+ * @retval 0 If successful.
+ * @retval Negative errno code if failure.
+ */
+static inline int behavior_device_binding_released(const struct device *dev,
+                                                   struct zmk_behavior_binding *binding,
+                                                   struct zmk_behavior_binding_event event) {
     if (dev == NULL) {
         return -EINVAL;
     }
@@ -148,6 +201,13 @@ static inline int z_impl_behavior_keymap_binding_released(struct zmk_behavior_bi
     return api->binding_released(binding, event);
 }
 
+static inline int z_impl_behavior_keymap_binding_released(struct zmk_behavior_binding *binding,
+                                                          struct zmk_behavior_binding_event event) {
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+
+    return behavior_device_binding_released(dev, binding, event);
+}
+
 /**
  * @brief Handle the a sensor keymap binding being triggered
  * @param dev Pointer to the device structure for the driver instance.
@@ -162,11 +222,18 @@ __syscall int behavior_sensor_keymap_binding_triggered(struct zmk_behavior_bindi
                                                        const struct device *sensor,
                                                        int64_t timestamp);
 
-static inline int
-z_impl_behavior_sensor_keymap_binding_triggered(struct zmk_behavior_binding *binding,
-                                                const struct device *sensor, int64_t timestamp) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
-
+/**
+ * @brief Same as behavior_sensor_keymap_binding_triggered, for a behavior device that has already
+ * been looked up
+ * @param dev Pointer to the device structure for the binding's behavior.
+ *
+ * @retval 0 If successful.
+ * @retval Negative errno code if failure.
+ */
+static inline int behavior_device_sensor_binding_triggered(const struct device *dev,
+                                                           struct zmk_behavior_binding *binding,
+                                                           const struct device *sensor,
+                                                           int64_t timestamp) {
     if (dev == NULL) {
         return -EINVAL;
     }
@@ -180,6 +247,14 @@ z_impl_behavior_sensor_keymap_binding_triggered(struct zmk_behavior_binding *bin
     return api->sensor_binding_triggered(binding, sensor, timestamp);
 }
 
+static inline int
+z_impl_behavior_sensor_keymap_binding_triggered(struct zmk_behavior_binding *binding,
+                                                const struct device *sensor, int64_t timestamp) {
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+
+    return behavior_device_sensor_binding_triggered(dev, binding, sensor, timestamp);
+}
+
 /**
  * @}
  */
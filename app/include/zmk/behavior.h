@@ -6,11 +6,60 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <devicetree.h>
+
 #define ZMK_BEHAVIOR_OPAQUE 0
 #define ZMK_BEHAVIOR_TRANSPARENT 1
 
+struct device;
+
+// Calls fn(node_id) for every enabled devicetree node that can be used as a binding, including the
+// macro control nodes, which don't have a driver.
+#define ZMK_BEHAVIOR_FOREACH(fn)                                                                   \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_backlight, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_bluetooth, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_caps_word, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_ext_power, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_hold_tap, fn)                                              \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_key_press, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_key_repeat, fn)                                            \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_macro, fn)                                                 \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_mod_morph, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_momentary_layer, fn)                                       \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_none, fn)                                                  \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_outputs, fn)                                               \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_reset, fn)                                                 \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_rgb_underglow, fn)                                         \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_sensor_rotate_key_press, fn)                               \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_sticky_key, fn)                                            \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_tap_dance, fn)                                             \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_to_layer, fn)                                              \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_toggle_layer, fn)                                          \
+    DT_FOREACH_STATUS_OKAY(zmk_behavior_transparent, fn)                                           \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_control_mode_tap, fn)                                         \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_control_mode_press, fn)                                       \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_control_mode_release, fn)                                     \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_control_tap_time, fn)                                         \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_control_wait_time, fn)                                        \
+    DT_FOREACH_STATUS_OKAY(zmk_macro_pause_for_release, fn)
+
+#define ZMK_BEHAVIOR_LOCAL_ID(node_id) _CONCAT(ZMK_BEHAVIOR_LOCAL_ID_, node_id)
+
+#define _ZMK_BEHAVIOR_LOCAL_ID_ENTRY(node_id) ZMK_BEHAVIOR_LOCAL_ID(node_id),
+
+// Compact identifier for a behavior, assigned densely from the devicetree at build time. Both
+// halves of a split keyboard share the same devicetree behaviors, so they agree on it regardless of
+// which behavior drivers each one builds. Zero is reserved so an empty binding never resolves.
+enum {
+    ZMK_BEHAVIOR_LOCAL_ID_NONE = 0,
+    ZMK_BEHAVIOR_FOREACH(_ZMK_BEHAVIOR_LOCAL_ID_ENTRY) ZMK_BEHAVIOR_LOCAL_ID_COUNT
+};
+
+typedef uint16_t zmk_behavior_local_id_t;
+
 struct zmk_behavior_binding {
-    char *behavior_dev;
+    zmk_behavior_local_id_t behavior_local_id;
     uint32_t param1;
     uint32_t param2;
 };
@@ -19,4 +68,8 @@ struct zmk_behavior_binding_event {
     int layer;
     uint32_t position;
     int64_t timestamp;
-};
\ No newline at end of file
+};
+
+// Returns NULL if the local ID is out of range, or if its node has no behavior driver built into
+// this firmware.
+const struct device *zmk_behavior_get_by_local_id(zmk_behavior_local_id_t local_id);
@@ -10,5 +10,9 @@
 #include <stdint.h>
 #include <zmk/behavior.h>
 
-int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding behavior,
+int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding *binding,
                            bool press, uint32_t wait);
+
+// Queues a press of the binding, and its release tap_ms later, as a single item.
+int zmk_behavior_queue_add_tap(uint32_t position, const struct zmk_behavior_binding *binding,
+                               uint32_t tap_ms, uint32_t wait);
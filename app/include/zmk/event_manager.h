@@ -10,13 +10,79 @@
 #include <kernel.h>
 #include <zephyr/types.h>
 
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+
+// Bucket 0 counts durations under 1us, bucket n counts durations in [2^(n-1), 2^n) us, and the
+// last bucket also collects everything longer.
+#define ZMK_EVENT_TRACE_BUCKETS 20
+
+struct zmk_event_trace_histogram {
+    uint32_t buckets[ZMK_EVENT_TRACE_BUCKETS];
+};
+
+struct zmk_event_subscription_trace {
+    // Time spent in the listener callback for this event type.
+    struct zmk_event_trace_histogram callback;
+    // Time events captured by this listener waited before being released or re-raised.
+    struct zmk_event_trace_histogram capture_wait;
+};
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE) */
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+
+struct zmk_event_type_stats {
+    uint32_t raised;
+    uint32_t bubbled;
+    uint32_t handled;
+    uint32_t captured;
+    uint32_t released;
+};
+
+struct zmk_event_manager_stats {
+    uint32_t live_events;
+    uint32_t peak_live_events;
+    size_t live_bytes;
+    size_t peak_live_bytes;
+};
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS) */
+
+// Runtime dispatch information for an event type, filled in by the event manager at init.
+// Subscriptions are sorted by event type at link time, so each type's listeners form one
+// contiguous run of the subscription section.
+struct zmk_event_type_data {
+    uint8_t subscriptions_start;
+    uint8_t subscriptions_len;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    // Number of allocations that found the slab exhausted and fell back to the heap.
+    uint32_t slab_fallbacks;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+    struct zmk_event_type_stats stats;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    // Time from an event first being raised until it is freed.
+    struct zmk_event_trace_histogram lifetime;
+#endif
+};
+
 struct zmk_event_type {
     const char *name;
+    struct zmk_event_type_data *data;
+    size_t size;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    struct k_mem_slab *slab;
+#endif
 };
 
 typedef struct {
     const struct zmk_event_type *event;
     uint8_t last_listener_index;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    uint32_t raised_at;
+    uint32_t captured_at;
+#endif
 } zmk_event_t;
 
 #define ZMK_EV_EVENT_BUBBLE 0
@@ -31,6 +97,13 @@ struct zmk_listener {
 struct zmk_event_subscription {
     const struct zmk_event_type *event_type;
     const struct zmk_listener *listener;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED)
+    bool deferred;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    const char *listener_name;
+    struct zmk_event_subscription_trace *trace;
+#endif
 };
 
 #define ZMK_EVENT_DECLARE(event_type)                                                              \
@@ -42,13 +115,30 @@ struct zmk_event_subscription {
     struct event_type *as_##event_type(const zmk_event_t *eh);                                     \
     extern const struct zmk_event_type zmk_event_##event_type;
 
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+#define ZMK_EVENT_SLAB_DEFINE(event_type)                                                          \
+    K_MEM_SLAB_DEFINE(zmk_event_slab_##event_type, sizeof(struct event_type##_event),              \
+                      CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCKS,                                        \
+                      __alignof__(struct event_type##_event));
+#define ZMK_EVENT_SLAB_REF(event_type) .slab = &zmk_event_slab_##event_type,
+#else
+#define ZMK_EVENT_SLAB_DEFINE(event_type)
+#define ZMK_EVENT_SLAB_REF(event_type)
+#endif
+
 #define ZMK_EVENT_IMPL(event_type)                                                                 \
-    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};          \
+    ZMK_EVENT_SLAB_DEFINE(event_type)                                                              \
+    static struct zmk_event_type_data zmk_event_data_##event_type;                                 \
+    const struct zmk_event_type zmk_event_##event_type = {                                         \
+        .name = STRINGIFY(event_type),                                                             \
+        .data = &zmk_event_data_##event_type,                                                      \
+        .size = sizeof(struct event_type##_event),                                                 \
+        ZMK_EVENT_SLAB_REF(event_type)};                                                           \
     const struct zmk_event_type *zmk_event_ref_##event_type __used                                 \
         __attribute__((__section__(".event_type"))) = &zmk_event_##event_type;                     \
     struct event_type##_event *new_##event_type(struct event_type data) {                          \
         struct event_type##_event *ev =                                                            \
-            (struct event_type##_event *)k_malloc(sizeof(struct event_type##_event));              \
+            (struct event_type##_event *)zmk_event_manager_alloc(&zmk_event_##event_type);         \
         ev->header.event = &zmk_event_##event_type;                                                \
         ev->data = data;                                                                           \
         return ev;                                                                                 \
@@ -60,13 +150,38 @@ struct zmk_event_subscription {
 
 #define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
 
-#define ZMK_SUBSCRIPTION(mod, ev_type)                                                             \
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+#define ZMK_SUBSCRIPTION_TRACE_DEFINE(mod, ev_type)                                                \
+    static struct zmk_event_subscription_trace _CONCAT(_CONCAT(zmk_event_sub_trace_, mod), ev_type);
+#define ZMK_SUBSCRIPTION_TRACE_REF(mod, ev_type)                                                   \
+    .listener_name = STRINGIFY(mod), .trace = &_CONCAT(_CONCAT(zmk_event_sub_trace_, mod), ev_type),
+#else
+#define ZMK_SUBSCRIPTION_TRACE_DEFINE(mod, ev_type)
+#define ZMK_SUBSCRIPTION_TRACE_REF(mod, ev_type)
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED)
+#define ZMK_SUBSCRIPTION_DEFERRED_REF(is_deferred) .deferred = is_deferred,
+#else
+#define ZMK_SUBSCRIPTION_DEFERRED_REF(is_deferred)
+#endif
+
+#define ZMK_SUBSCRIPTION_DEFINE(mod, ev_type, is_deferred)                                         \
+    ZMK_SUBSCRIPTION_TRACE_DEFINE(mod, ev_type)                                                    \
     const Z_DECL_ALIGN(struct zmk_event_subscription)                                              \
         _CONCAT(_CONCAT(zmk_event_sub_, mod), ev_type) __used                                      \
-        __attribute__((__section__(".event_subscription"))) = {                                    \
+        __attribute__((__section__(".event_subscription." STRINGIFY(ev_type)))) = {                \
             .event_type = &zmk_event_##ev_type,                                                    \
             .listener = &zmk_listener_##mod,                                                       \
-    };
+            ZMK_SUBSCRIPTION_DEFERRED_REF(is_deferred) ZMK_SUBSCRIPTION_TRACE_REF(mod, ev_type)};
+
+#define ZMK_SUBSCRIPTION(mod, ev_type) ZMK_SUBSCRIPTION_DEFINE(mod, ev_type, false)
+
+// Deferred listeners get a copy of the event from a low priority work queue instead of being
+// called in the raising context. They can only observe events: the return value is ignored, so
+// they cannot handle or capture them. Without CONFIG_ZMK_EVENT_MANAGER_DEFERRED they are called
+// synchronously like any other listener.
+#define ZMK_SUBSCRIPTION_DEFERRED(mod, ev_type) ZMK_SUBSCRIPTION_DEFINE(mod, ev_type, true)
 
 #define ZMK_EVENT_RAISE(ev) zmk_event_manager_raise((zmk_event_t *)ev);
 
@@ -78,9 +193,31 @@ struct zmk_event_subscription {
 
 #define ZMK_EVENT_RELEASE(ev) zmk_event_manager_release((zmk_event_t *)ev);
 
-#define ZMK_EVENT_FREE(ev) k_free((void *)ev);
+#define ZMK_EVENT_FREE(ev) zmk_event_manager_free((zmk_event_t *)ev);
+
+// Listeners that only care about events while they have some active state can disable their
+// subscription the rest of the time, so dispatch skips them entirely.
+#define ZMK_SUBSCRIPTION_ENABLE(mod, ev_type)                                                      \
+    zmk_event_manager_subscription_set_enabled(&zmk_event_##ev_type, &zmk_listener_##mod, true);
+
+#define ZMK_SUBSCRIPTION_DISABLE(mod, ev_type)                                                     \
+    zmk_event_manager_subscription_set_enabled(&zmk_event_##ev_type, &zmk_listener_##mod, false);
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type);
+void zmk_event_manager_free(zmk_event_t *event);
 
 int zmk_event_manager_raise(zmk_event_t *event);
 int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener);
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener);
-int zmk_event_manager_release(zmk_event_t *event);
\ No newline at end of file
+int zmk_event_manager_release(zmk_event_t *event);
+int zmk_event_manager_subscription_set_enabled(const struct zmk_event_type *type,
+                                               const struct zmk_listener *listener, bool enabled);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+void zmk_event_manager_stats_get(struct zmk_event_manager_stats *stats);
+void zmk_event_manager_stats_reset_peaks();
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+void zmk_event_trace_record(struct zmk_event_trace_histogram *histogram, uint32_t cycles);
+#endif
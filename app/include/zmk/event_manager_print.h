@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <logging/log.h>
+
+#if IS_ENABLED(CONFIG_SHELL)
+#include <shell/shell.h>
+#else
+struct shell;
+#endif
+
+// Prints the event manager's diagnostics to the shell they were requested from, or logs them if
+// sh is NULL. The including file must have declared its log module. String arguments aren't
+// copied with log_strdup, so they have to be constant.
+#if IS_ENABLED(CONFIG_SHELL)
+#define EM_PRINT(sh, fmt, ...)                                                                     \
+    do {                                                                                           \
+        if (sh != NULL) {                                                                          \
+            shell_print(sh, fmt, ##__VA_ARGS__);                                                   \
+        } else {                                                                                   \
+            LOG_INF(fmt, ##__VA_ARGS__);                                                           \
+        }                                                                                          \
+    } while (0)
+#else
+#define EM_PRINT(sh, fmt, ...) LOG_INF(fmt, ##__VA_ARGS__)
+#endif
@@ -8,17 +8,27 @@
 
 #include <zephyr.h>
 #include <zmk/event_manager.h>
+#include <zmk/keymap.h>
 
 struct zmk_layer_state_changed {
+    // When several layers change at once, the highest of them.
     uint8_t layer;
     bool state;
+    zmk_keymap_layers_state_t old_state;
+    zmk_keymap_layers_state_t new_state;
     int64_t timestamp;
 };
 
 ZMK_EVENT_DECLARE(zmk_layer_state_changed);
 
-static inline struct zmk_layer_state_changed_event *create_layer_state_changed(uint8_t layer,
-                                                                               bool state) {
+static inline struct zmk_layer_state_changed_event *
+create_layer_state_changed(zmk_keymap_layers_state_t old_state,
+                           zmk_keymap_layers_state_t new_state) {
+    uint8_t layer = zmk_keymap_layers_state_highest(old_state ^ new_state);
     return new_zmk_layer_state_changed((struct zmk_layer_state_changed){
-        .layer = layer, .state = state, .timestamp = k_uptime_get()});
+        .layer = layer,
+        .state = (new_state & ZMK_KEYMAP_LAYER_BIT(layer)) != 0,
+        .old_state = old_state,
+        .new_state = new_state,
+        .timestamp = k_uptime_get()});
 }
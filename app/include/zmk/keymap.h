@@ -6,12 +6,36 @@
 
 #pragma once
 
+#include <zmk/behavior.h>
 #include <zmk/events/position_state_changed.h>
 
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_LAYER_STATE_8_BIT)
+typedef uint8_t zmk_keymap_layers_state_t;
+#elif IS_ENABLED(CONFIG_ZMK_KEYMAP_LAYER_STATE_16_BIT)
+typedef uint16_t zmk_keymap_layers_state_t;
+#elif IS_ENABLED(CONFIG_ZMK_KEYMAP_LAYER_STATE_64_BIT)
+typedef uint64_t zmk_keymap_layers_state_t;
+#else
 typedef uint32_t zmk_keymap_layers_state_t;
+#endif
+
+#define ZMK_KEYMAP_LAYERS_STATE_BITS (sizeof(zmk_keymap_layers_state_t) * 8)
+
+#define ZMK_KEYMAP_LAYER_CHILD_LEN(node) 1 +
+#define ZMK_KEYMAP_LAYERS_LEN                                                                      \
+    (DT_FOREACH_CHILD(DT_INST(0, zmk_keymap), ZMK_KEYMAP_LAYER_CHILD_LEN) 0)
+
+// BIT() is only as wide as a long, which is too narrow for a 64 layer state.
+#define ZMK_KEYMAP_LAYER_BIT(layer) ((zmk_keymap_layers_state_t)1 << (layer))
+
+// The highest layer set in a non-empty layer state.
+static inline uint8_t zmk_keymap_layers_state_highest(zmk_keymap_layers_state_t state) {
+    return (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(state);
+}
 
 uint8_t zmk_keymap_layer_default();
 zmk_keymap_layers_state_t zmk_keymap_layer_state();
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t layer_state);
 bool zmk_keymap_layer_active(uint8_t layer);
 uint8_t zmk_keymap_highest_layer_active();
 int zmk_keymap_layer_activate(uint8_t layer);
@@ -20,12 +44,18 @@ int zmk_keymap_layer_toggle(uint8_t layer);
 int zmk_keymap_layer_to(uint8_t layer);
 const char *zmk_keymap_layer_label(uint8_t layer);
 
+// The binding a press of the position would invoke with the current layer state, ignoring
+// behaviors that ask to continue to a lower layer. Sets behavior to its device, or NULL if the
+// behavior isn't part of this build.
+const struct zmk_behavior_binding *zmk_keymap_position_binding(uint32_t position,
+                                                               const struct device **behavior);
+
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp);
 
 #define ZMK_KEYMAP_EXTRACT_BINDING(idx, drv_inst)                                                  \
     {                                                                                              \
-        .behavior_dev = DT_LABEL(DT_PHANDLE_BY_IDX(drv_inst, bindings, idx)),                      \
+        .behavior_local_id = ZMK_BEHAVIOR_LOCAL_ID(DT_PHANDLE_BY_IDX(drv_inst, bindings, idx)),    \
         .param1 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(drv_inst, bindings, idx, param1), (0),        \
                               (DT_PHA_BY_IDX(drv_inst, bindings, idx, param1))),                   \
         .param2 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(drv_inst, bindings, idx, param2), (0),        \
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/util.h>
+#include <zmk/matrix.h>
+
+// Allocates the slots of a behavior's table of active instances, and finds the slot that belongs
+// to a key position in constant time. Positions beyond the keymap, like the virtual positions of
+// combos, are found by a scan of the slots in use.
+//
+// A slot stays in use until it is freed, but can be unlinked from its position before that, for
+// example while a timer that still refers to it is running. Another slot can then be allocated
+// for the same position.
+struct zmk_position_slots {
+    uint8_t len;
+    // 1 + the slot linked to each key position, or 0 if there is none
+    uint8_t *by_position;
+    // the position each slot was allocated for
+    uint32_t *positions;
+    // bitmaps of the slots in use, and of the slots still linked to their position
+    uint32_t *used;
+    uint32_t *linked;
+};
+
+#define ZMK_POSITION_SLOTS_WORDS(slots_len) DIV_ROUND_UP(slots_len, 32)
+
+#define ZMK_POSITION_SLOTS_DEFINE(name, slots_len)                                                 \
+    BUILD_ASSERT((slots_len) < UINT8_MAX, "Too many slots for " #name);                            \
+    static uint8_t name##_by_position[ZMK_KEYMAP_LEN];                                             \
+    static uint32_t name##_positions[slots_len];                                                   \
+    static uint32_t name##_used[ZMK_POSITION_SLOTS_WORDS(slots_len)];                              \
+    static uint32_t name##_linked[ZMK_POSITION_SLOTS_WORDS(slots_len)];                            \
+    static struct zmk_position_slots name = {                                                      \
+        .len = (slots_len),                                                                        \
+        .by_position = name##_by_position,                                                         \
+        .positions = name##_positions,                                                             \
+        .used = name##_used,                                                                       \
+        .linked = name##_linked,                                                                   \
+    }
+
+static inline bool zmk_position_slots_is_linked(const struct zmk_position_slots *slots, int slot) {
+    return slots->linked[slot / 32] & BIT(slot % 32);
+}
+
+// Returns the slot linked to the position, or -ENOENT.
+static inline int zmk_position_slots_find(const struct zmk_position_slots *slots,
+                                          uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        uint8_t linked = slots->by_position[position];
+        return linked != 0 ? linked - 1 : -ENOENT;
+    }
+
+    for (int slot = 0; slot < slots->len; slot++) {
+        if (slots->positions[slot] == position && zmk_position_slots_is_linked(slots, slot)) {
+            return slot;
+        }
+    }
+    return -ENOENT;
+}
+
+// Allocates the lowest free slot and links it to the position. Returns the slot, or -ENOMEM.
+static inline int zmk_position_slots_alloc(struct zmk_position_slots *slots, uint32_t position) {
+    for (int i = 0; i < ZMK_POSITION_SLOTS_WORDS(slots->len); i++) {
+        if (slots->used[i] == UINT32_MAX) {
+            continue;
+        }
+
+        int slot = i * 32 + __builtin_ctz(~slots->used[i]);
+        if (slot >= slots->len) {
+            break;
+        }
+
+        slots->used[i] |= BIT(slot % 32);
+        slots->linked[i] |= BIT(slot % 32);
+        slots->positions[slot] = position;
+        if (position < ZMK_KEYMAP_LEN) {
+            slots->by_position[position] = slot + 1;
+        }
+        return slot;
+    }
+    return -ENOMEM;
+}
+
+static inline void zmk_position_slots_unlink(struct zmk_position_slots *slots, int slot) {
+    uint32_t position = slots->positions[slot];
+    if (position < ZMK_KEYMAP_LEN && slots->by_position[position] == slot + 1) {
+        slots->by_position[position] = 0;
+    }
+    slots->linked[slot / 32] &= ~BIT(slot % 32);
+}
+
+static inline void zmk_position_slots_free(struct zmk_position_slots *slots, int slot) {
+    zmk_position_slots_unlink(slots, slot);
+    slots->used[slot / 32] &= ~BIT(slot % 32);
+}
+
+// Returns the next slot in use after the given one, or -1. Start with -1 to get the first one.
+static inline int zmk_position_slots_next(const struct zmk_position_slots *slots, int slot) {
+    for (int i = (slot + 1) / 32; i < ZMK_POSITION_SLOTS_WORDS(slots->len); i++) {
+        uint32_t bits = slots->used[i];
+        if (i == (slot + 1) / 32) {
+            bits &= ~(BIT((slot + 1) % 32) - 1);
+        }
+        if (bits != 0) {
+            return i * 32 + __builtin_ctz(bits);
+        }
+    }
+    return -1;
+}
+
+#define ZMK_POSITION_SLOTS_FOREACH(slots, slot)                                                    \
+    for (int slot = zmk_position_slots_next(slots, -1); slot >= 0;                                 \
+         slot = zmk_position_slots_next(slots, slot))
+
+static inline bool zmk_position_slots_is_empty(const struct zmk_position_slots *slots) {
+    for (int i = 0; i < ZMK_POSITION_SLOTS_WORDS(slots->len); i++) {
+        if (slots->used[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
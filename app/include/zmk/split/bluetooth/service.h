@@ -6,7 +6,7 @@
 
 #pragma once
 
-#define ZMK_SPLIT_RUN_BEHAVIOR_DEV_LEN 9
+#include <zmk/behavior.h>
 
 struct zmk_split_run_behavior_data {
     uint8_t position;
@@ -17,7 +17,7 @@ struct zmk_split_run_behavior_data {
 
 struct zmk_split_run_behavior_payload {
     struct zmk_split_run_behavior_data data;
-    char behavior_dev[ZMK_SPLIT_RUN_BEHAVIOR_DEV_LEN];
+    zmk_behavior_local_id_t behavior_local_id;
 } __packed;
 
 int zmk_split_bt_position_pressed(uint8_t position);
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <device.h>
+
+#include <drivers/behavior.h>
+#include <zmk/behavior.h>
+
+BUILD_ASSERT(ZMK_BEHAVIOR_LOCAL_ID_COUNT <= UINT16_MAX, "Too many behaviors for a local ID");
+
+// Nodes whose driver isn't built, like the macro controls or central-only behaviors on a split
+// peripheral, have no device and resolve to NULL.
+#define BEHAVIOR_DEVICE_DECLARE(node_id)                                                           \
+    extern const struct device DEVICE_DT_NAME_GET(node_id) __weak;
+
+ZMK_BEHAVIOR_FOREACH(BEHAVIOR_DEVICE_DECLARE)
+
+#define BEHAVIOR_DEVICE_ENTRY(node_id)                                                             \
+    [ZMK_BEHAVIOR_LOCAL_ID(node_id)] = &DEVICE_DT_NAME_GET(node_id),
+
+static const struct device *const behaviors[ZMK_BEHAVIOR_LOCAL_ID_COUNT] = {
+    ZMK_BEHAVIOR_FOREACH(BEHAVIOR_DEVICE_ENTRY)};
+
+const struct device *zmk_behavior_get_by_local_id(zmk_behavior_local_id_t local_id) {
+    if (local_id >= ZMK_BEHAVIOR_LOCAL_ID_COUNT) {
+        return NULL;
+    }
+
+    return behaviors[local_id];
+}
@@ -15,52 +15,232 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 struct q_item {
     uint32_t position;
     struct zmk_behavior_binding binding;
+    bool used : 1;
     bool press : 1;
-    uint32_t wait : 31;
+    // pressed, then released tap_ms later, as a single item
+    bool tap : 1;
+    // clamped to WAIT_MAX_MS, a little over six days
+    uint32_t wait : 29;
+    uint32_t tap_ms;
+    // the next item in the same lane, if it's not the lane's tail
+    int16_t next;
 };
 
-K_MSGQ_DEFINE(zmk_behavior_queue_msgq, sizeof(struct q_item), CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE, 4);
+// The items queued from one position, e.g. by a macro, are processed in order in their own lane,
+// so a wait in one macro doesn't hold up the behaviors queued by another one.
+struct q_lane {
+    uint32_t position;
+    // The position of the item processed last, which the lane may still be waiting after.
+    uint32_t last_position;
+    uint16_t count;
+    int16_t head;
+    int16_t tail;
+    int64_t wait_until;
+    bool waiting : 1;
+    bool processing : 1;
+    // Set while the tap at the head of the lane has been pressed, and waits to be released.
+    bool tap_pressed : 1;
+    // Set once other positions had to be queued in this lane because all lanes were busy.
+    bool overflowed : 1;
+};
+
+#define WAIT_MAX_MS (BIT(29) - 1)
+
+BUILD_ASSERT(CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE <= INT16_MAX, "Behavior queue is too large");
+
+static struct q_item items[CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE];
+static struct q_lane lanes[CONFIG_ZMK_BEHAVIORS_QUEUE_LANES];
+
+static void behavior_queue_timer_expired(struct k_work *work);
+// Shared by all lanes, and scheduled for the lane whose wait ends first.
+static K_WORK_DELAYABLE_DEFINE(queue_work, behavior_queue_timer_expired);
+
+static bool lane_is_active(const struct q_lane *lane) {
+    return lane->count > 0 || lane->waiting || lane->processing;
+}
+
+// A lane can hold items of other positions than its own once all lanes have been busy, and those
+// positions have to stay in that lane until their items are done, to keep them in order.
+static bool lane_holds_position(const struct q_lane *lane, uint32_t position) {
+    if (!lane_is_active(lane)) {
+        return false;
+    }
+
+    if (lane->position == position) {
+        return true;
+    }
+
+    if ((lane->waiting || lane->processing) && lane->last_position == position) {
+        return true;
+    }
+
+    for (int i = 0, index = lane->head; i < lane->count; i++, index = items[index].next) {
+        if (items[index].position == position) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct q_lane *find_lane(uint32_t position) {
+    struct q_lane *free_lane = NULL;
+
+    for (int i = 0; i < CONFIG_ZMK_BEHAVIORS_QUEUE_LANES; i++) {
+        struct q_lane *lane = &lanes[i];
+        if (lane_holds_position(lane, position)) {
+            return lane;
+        }
+
+        if (free_lane == NULL && !lane_is_active(lane)) {
+            free_lane = lane;
+        }
+    }
+
+    if (free_lane == NULL) {
+        // all lanes are busy, so queue behind the behaviors of another position instead
+        struct q_lane *lane = &lanes[0];
+        if (!lane->overflowed) {
+            LOG_WRN("No free behavior queue lane for position %d", position);
+            lane->overflowed = true;
+        }
+        return lane;
+    }
+
+    *free_lane = (struct q_lane){.position = position};
+    return free_lane;
+}
 
-static void behavior_queue_process_next(struct k_work *work);
-static K_WORK_DELAYABLE_DEFINE(queue_work, behavior_queue_process_next);
+static int alloc_item(void) {
+    for (int i = 0; i < CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE; i++) {
+        if (!items[i].used) {
+            return i;
+        }
+    }
+    return -ENOMEM;
+}
+
+static void behavior_queue_process_next(struct q_lane *lane) {
+    lane->processing = true;
 
-static void behavior_queue_process_next(struct k_work *work) {
-    struct q_item item = {.wait = 0};
+    // items stay in the lane until they're done, so a tap can be released after its tap_ms
+    while (lane->count > 0) {
+        struct q_item *item = &items[lane->head];
+        const bool press = item->tap ? !lane->tap_pressed : item->press;
+        uint32_t wait;
 
-    while (k_msgq_get(&zmk_behavior_queue_msgq, &item, K_NO_WAIT) == 0) {
-        LOG_DBG("Invoking %s: 0x%02x 0x%02x", log_strdup(item.binding.behavior_dev),
-                item.binding.param1, item.binding.param2);
+        lane->last_position = item->position;
 
-        struct zmk_behavior_binding_event event = {.position = item.position,
+        struct zmk_behavior_binding binding = item->binding;
+        const struct device *behavior = zmk_behavior_get_by_local_id(binding.behavior_local_id);
+        struct zmk_behavior_binding_event event = {.position = item->position,
                                                    .timestamp = k_uptime_get()};
 
-        if (item.press) {
-            behavior_keymap_binding_pressed(&item.binding, event);
+        if (behavior == NULL) {
+            LOG_ERR("No behavior with local ID %d", binding.behavior_local_id);
         } else {
-            behavior_keymap_binding_released(&item.binding, event);
+            LOG_DBG("Invoking %s: 0x%02x 0x%02x", behavior->name, binding.param1, binding.param2);
+
+            if (press) {
+                behavior_device_binding_pressed(behavior, &binding, event);
+            } else {
+                behavior_device_binding_released(behavior, &binding, event);
+            }
         }
 
-        LOG_DBG("Processing next queued behavior in %dms", item.wait);
+        if (item->tap && press) {
+            lane->tap_pressed = true;
+            wait = item->tap_ms;
+        } else {
+            lane->tap_pressed = false;
+            wait = item->wait;
+
+            item->used = false;
+            lane->head = item->next;
+            lane->count--;
+        }
 
-        if (item.wait > 0) {
-            k_work_schedule(&queue_work, K_MSEC(item.wait));
+        LOG_DBG("Processing next queued behavior in %dms", wait);
+
+        if (wait > 0) {
+            lane->waiting = true;
+            lane->wait_until = k_uptime_get() + wait;
             break;
         }
     }
+
+    lane->processing = false;
+}
+
+static void schedule_queue_work(void) {
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < CONFIG_ZMK_BEHAVIORS_QUEUE_LANES; i++) {
+        if (lanes[i].waiting) {
+            next = MIN(next, lanes[i].wait_until);
+        }
+    }
+
+    if (next != INT64_MAX) {
+        k_work_reschedule(&queue_work, K_MSEC(MAX(next - k_uptime_get(), 0)));
+    }
 }
 
-int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding binding, bool press,
-                           uint32_t wait) {
-    struct q_item item = {.press = press, .binding = binding, .wait = wait};
+static void behavior_queue_timer_expired(struct k_work *work) {
+    const int64_t now = k_uptime_get();
+
+    for (int i = 0; i < CONFIG_ZMK_BEHAVIORS_QUEUE_LANES; i++) {
+        struct q_lane *lane = &lanes[i];
+        if (lane->waiting && lane->wait_until <= now) {
+            lane->waiting = false;
+            behavior_queue_process_next(lane);
+        }
+    }
+
+    schedule_queue_work();
+}
 
-    const int ret = k_msgq_put(&zmk_behavior_queue_msgq, &item, K_NO_WAIT);
-    if (ret < 0) {
-        return ret;
+static int queue_add(const struct q_item *item) {
+    struct q_lane *lane = find_lane(item->position);
+    const int index = alloc_item();
+    if (index < 0) {
+        return index;
     }
 
-    if (!k_work_delayable_is_pending(&queue_work)) {
-        behavior_queue_process_next(&queue_work.work);
+    items[index] = *item;
+    items[index].used = true;
+    if (lane->count > 0) {
+        items[lane->tail].next = index;
+    } else {
+        lane->head = index;
+    }
+    lane->tail = index;
+    lane->count++;
+
+    // a lane that's waiting, or already being processed further up the stack, picks it up later
+    if (!lane->waiting && !lane->processing) {
+        behavior_queue_process_next(lane);
+        schedule_queue_work();
     }
 
     return 0;
 }
+
+int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding *binding,
+                           bool press, uint32_t wait) {
+    struct q_item item = {
+        .position = position, .binding = *binding, .press = press, .wait = MIN(wait, WAIT_MAX_MS)};
+
+    return queue_add(&item);
+}
+
+int zmk_behavior_queue_add_tap(uint32_t position, const struct zmk_behavior_binding *binding,
+                               uint32_t tap_ms, uint32_t wait) {
+    struct q_item item = {.position = position,
+                          .binding = *binding,
+                          .tap = true,
+                          .tap_ms = tap_ms,
+                          .wait = MIN(wait, WAIT_MAX_MS)};
+
+    return queue_add(&item);
+}
@@ -40,21 +40,38 @@ struct behavior_caps_word_data {
     bool active;
 };
 
+static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh);
+
+ZMK_LISTENER(behavior_caps_word, caps_word_keycode_state_changed_listener);
+ZMK_SUBSCRIPTION(behavior_caps_word, zmk_keycode_state_changed);
+
+static const struct device *devs[DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)];
+
 static void activate_caps_word(const struct device *dev) {
     struct behavior_caps_word_data *data = dev->data;
 
     data->active = true;
+    ZMK_SUBSCRIPTION_ENABLE(behavior_caps_word, zmk_keycode_state_changed);
 }
 
 static void deactivate_caps_word(const struct device *dev) {
     struct behavior_caps_word_data *data = dev->data;
 
     data->active = false;
+
+    for (int i = 0; i < DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT); i++) {
+        if (devs[i] != NULL && ((struct behavior_caps_word_data *)devs[i]->data)->active) {
+            return;
+        }
+    }
+
+    // Keycodes only need shifting or checking for a word break while caps word is active.
+    ZMK_SUBSCRIPTION_DISABLE(behavior_caps_word, zmk_keycode_state_changed);
 }
 
 static int on_caps_word_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     struct behavior_caps_word_data *data = dev->data;
 
     if (data->active) {
@@ -76,13 +93,6 @@ static const struct behavior_driver_api behavior_caps_word_driver_api = {
     .binding_released = on_caps_word_binding_released,
 };
 
-static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh);
-
-ZMK_LISTENER(behavior_caps_word, caps_word_keycode_state_changed_listener);
-ZMK_SUBSCRIPTION(behavior_caps_word, zmk_keycode_state_changed);
-
-static const struct device *devs[DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)];
-
 static bool caps_word_is_caps_includelist(const struct behavior_caps_word_config *config,
                                           uint16_t usage_page, uint8_t usage_id,
                                           uint8_t implicit_modifiers) {
@@ -156,6 +166,7 @@ static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh) {
 static int behavior_caps_word_init(const struct device *dev) {
     const struct behavior_caps_word_config *config = dev->config;
     devs[config->index] = dev;
+    ZMK_SUBSCRIPTION_DISABLE(behavior_caps_word, zmk_keycode_state_changed);
     return 0;
 }
 
@@ -176,9 +187,9 @@ static int behavior_caps_word_init(const struct device *dev) {
         .continuations = {UTIL_LISTIFY(DT_INST_PROP_LEN(n, continue_list), BREAK_ITEM, n)},        \
         .continuations_count = DT_INST_PROP_LEN(n, continue_list),                                 \
     };                                                                                             \
-    DEVICE_DT_INST_DEFINE(n, behavior_caps_word_init, NULL, &behavior_caps_word_data_##n,          \
-                          &behavior_caps_word_config_##n, APPLICATION,                             \
-                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_caps_word_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_caps_word_init, NULL, &behavior_caps_word_data_##n,        \
+                            &behavior_caps_word_config_##n, APPLICATION,                           \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_caps_word_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
@@ -19,16 +19,19 @@
 #include <zmk/events/keycode_state_changed.h>
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
+#include <zmk/position_slots.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
+#define ZMK_BHV_HOLD_TAP_MAX_HELD CONFIG_ZMK_BEHAVIOR_HOLD_TAP_MAX_HELD
+// must be a power of two, so the ring buffer indexes stay valid when they wrap around.
+#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 64
 
-// increase if you have keyboard with more keys.
-#define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
+BUILD_ASSERT(
+    (ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS & (ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS - 1)) == 0,
+    "ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS must be a power of two");
 
 enum flavor {
     FLAVOR_HOLD_PREFERRED,
@@ -54,12 +57,14 @@ enum decision_moment {
 
 struct behavior_hold_tap_config {
     int tapping_term_ms;
-    char *hold_behavior_dev;
-    char *tap_behavior_dev;
+    zmk_behavior_local_id_t hold_behavior_local_id;
+    zmk_behavior_local_id_t tap_behavior_local_id;
     int quick_tap_ms;
+    int require_prior_idle_ms;
     bool global_quick_tap;
     enum flavor flavor;
     bool retro_tap;
+    bool hold_while_undecided;
     int32_t hold_trigger_key_positions_len;
     int32_t hold_trigger_key_positions[];
 };
@@ -74,20 +79,44 @@ struct active_hold_tap {
     const struct behavior_hold_tap_config *config;
     struct k_work_delayable work;
     bool work_is_cancelled;
+    // set if the hold behavior was pressed before the hold-tap was decided
+    bool held_while_undecided;
 
     // initialized to -1, which is to be interpreted as "no other key has been pressed yet"
     int32_t position_of_first_other_key_pressed;
+
+    // set while the key-down of this hold-tap is captured by the undecided hold-tap. It runs its
+    // own timer and is decided on the events captured after its key-down, but is only pressed
+    // once its key-down has been released to the keymap.
+    bool captured;
+    // the sequence number of the captured key-down
+    uint32_t captured_seq;
 };
 
 // The undecided hold tap is the hold tap that needs to be decided before
 // other keypress events can be released. While the undecided_hold_tap is
 // not NULL, most events are captured in captured_events.
+// Hold-taps whose key-downs are captured are decided alongside it, see
+// active_hold_tap.captured.
 // After the hold_tap is decided, it will stay in the active_hold_taps until
 // its key-up has been processed and the delayed work is cleaned up.
 struct active_hold_tap *undecided_hold_tap = NULL;
 struct active_hold_tap active_hold_taps[ZMK_BHV_HOLD_TAP_MAX_HELD] = {};
+// the slots of active_hold_taps in use, and which one belongs to each key position
+ZMK_POSITION_SLOTS_DEFINE(hold_tap_slots, ZMK_BHV_HOLD_TAP_MAX_HELD);
 // We capture most position_state_changed events and some modifiers_state_changed events.
+// captured_events is a ring buffer, indexed by free running sequence numbers modulo its size.
+// The events captured by the undecided hold-tap are the ones from captured_events_head up to, but
+// not including, captured_events_tail. Events before captured_events_head that are not older than
+// captured_events_oldest are still being released by a hold-tap that was decided.
 const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+uint32_t captured_events_oldest = 0;
+uint32_t captured_events_head = 0;
+uint32_t captured_events_tail = 0;
+// the sequence number of the last key down captured for each position
+uint32_t captured_keydowns[ZMK_KEYMAP_LEN] = {};
+
+#define CAPTURED_EVENT(seq) captured_events[(seq) % ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS]
 
 // Keep track of which key was tapped most recently for the standard, if it is a hold-tap
 // a position, will be given, if not it will just be INT32_MIN
@@ -111,6 +140,12 @@ static void store_last_hold_tapped(struct active_hold_tap *hold_tap) {
 }
 
 static bool is_quick_tap(struct active_hold_tap *hold_tap) {
+    // a hold-tap pressed while typing is taken as a tap, whichever key was tapped before it
+    if (hold_tap->config->require_prior_idle_ms > 0 &&
+        (last_tapped.timestamp + hold_tap->config->require_prior_idle_ms) > hold_tap->timestamp) {
+        return true;
+    }
+
     if (hold_tap->config->global_quick_tap || last_tapped.position == hold_tap->position) {
         return (last_tapped.timestamp + hold_tap->config->quick_tap_ms) > hold_tap->timestamp;
     } else {
@@ -118,75 +153,84 @@ static bool is_quick_tap(struct active_hold_tap *hold_tap) {
     }
 }
 
-static int capture_event(const zmk_event_t *event) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i] == NULL) {
-            captured_events[i] = event;
-            return 0;
-        }
+static bool captured_events_full() {
+    return captured_events_tail - captured_events_oldest == ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS;
+}
+
+static void capture_event(const zmk_event_t *event) {
+    struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(event);
+    if (position_event != NULL && position_event->state &&
+        position_event->position < ZMK_KEYMAP_LEN) {
+        captured_keydowns[position_event->position] = captured_events_tail;
     }
-    return -ENOMEM;
+    CAPTURED_EVENT(captured_events_tail++) = event;
+}
+
+static bool is_captured_by_undecided(uint32_t seq) {
+    return seq - captured_events_head < captured_events_tail - captured_events_head;
 }
 
 static struct zmk_position_state_changed *find_captured_keydown_event(uint32_t position) {
-    struct zmk_position_state_changed *last_match = NULL;
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *eh = captured_events[i];
-        if (eh == NULL) {
-            return last_match;
-        }
-        struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
-        if (position_event == NULL) {
-            continue;
-        }
+    if (position >= ZMK_KEYMAP_LEN) {
+        return NULL;
+    }
 
-        if (position_event->position == position && position_event->state) {
-            last_match = position_event;
-        }
+    // only key downs captured by the undecided hold-tap count
+    uint32_t seq = captured_keydowns[position];
+    if (!is_captured_by_undecided(seq)) {
+        return NULL;
+    }
+
+    struct zmk_position_state_changed *position_event =
+        as_zmk_position_state_changed(CAPTURED_EVENT(seq));
+    if (position_event == NULL || position_event->position != position || !position_event->state) {
+        return NULL;
     }
-    return last_match;
+    return position_event;
 }
 
 const struct zmk_listener zmk_listener_behavior_hold_tap;
 
+static const struct behavior_driver_api behavior_hold_tap_driver_api;
+static void discard_captured_hold_tap(uint32_t seq);
+
 static void release_captured_events() {
     if (undecided_hold_tap != NULL) {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
+    // The events of the hold-tap that was just decided are detached from the ring buffer before
+    // they are released, by moving captured_events_head up to the tail.
     //
-    // The first event popped will never be catched by the next active hold-tap
+    // The first event released will never be caught by the next active hold-tap
     // because to start capturing a mod-tap-key-down event must first completely
     // go through the events queue.
     //
     // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
-    //  ^
+    // [mt2_down, k1_down, k1_up, mt2_up]
+    //  ^ released                        ^ head
     // mt2_down position event isn't captured because no hold-tap is active.
     // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
-    //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
-    // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *captured_event = captured_events[i];
-        if (captured_event == NULL) {
-            return;
-        }
-        captured_events[i] = NULL;
-        if (undecided_hold_tap != NULL) {
-            k_msleep(10);
+    // [mt2_down, k1_down, k1_up, mt2_up, k1_down]
+    //            ^ released              ^ head
+    // k1_down is captured by the mt2 mod-tap, after the detached events.
+    // Searches by find_captured_keydown_event only look from the head.
+    // [mt2_down, k1_down, k1_up, mt2_up, k1_down, k1_up]
+    //                     ^ released     ^ head
+    // k1_up event is captured by the new hold-tap.
+    // [mt2_down, k1_down, k1_up, mt2_up, k1_down, k1_up]
+    //                            ^ released
+    // mt2_up event is not captured but causes release of mt2 behavior, which
+    // detaches and releases only its own captured events, from the head.
+    uint32_t end = captured_events_tail;
+    uint32_t seq = captured_events_head;
+    captured_events_head = end;
+    for (; seq != end; seq++) {
+        const zmk_event_t *captured_event = CAPTURED_EVENT(seq);
+        CAPTURED_EVENT(seq) = NULL;
+        if (seq == captured_events_oldest) {
+            // free the slot before the event can be captured again
+            captured_events_oldest++;
         }
 
         struct zmk_position_state_changed *position_event;
@@ -199,41 +243,64 @@ static void release_captured_events() {
                     (modifier_event->state ? "pressed" : "released"));
         }
         ZMK_EVENT_RAISE_AT(captured_event, behavior_hold_tap);
+        discard_captured_hold_tap(seq);
+    }
+
+    if (captured_events_oldest == end) {
+        // this was the outermost release, so everything before the head has been released
+        captured_events_oldest = captured_events_head;
     }
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position == position) {
-            return &active_hold_taps[i];
-        }
+    int slot = zmk_position_slots_find(&hold_tap_slots, position);
+    if (slot < 0 || active_hold_taps[slot].captured) {
+        return NULL;
+    }
+    return &active_hold_taps[slot];
+}
+
+static struct active_hold_tap *find_captured_hold_tap(uint32_t position) {
+    int slot = zmk_position_slots_find(&hold_tap_slots, position);
+    if (slot < 0 || !active_hold_taps[slot].captured) {
+        return NULL;
     }
-    return NULL;
+    return &active_hold_taps[slot];
 }
 
 static struct active_hold_tap *store_hold_tap(uint32_t position, uint32_t param_hold,
                                               uint32_t param_tap, int64_t timestamp,
                                               const struct behavior_hold_tap_config *config) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position != ZMK_BHV_HOLD_TAP_POSITION_NOT_USED) {
-            continue;
-        }
-        active_hold_taps[i].position = position;
-        active_hold_taps[i].status = STATUS_UNDECIDED;
-        active_hold_taps[i].config = config;
-        active_hold_taps[i].param_hold = param_hold;
-        active_hold_taps[i].param_tap = param_tap;
-        active_hold_taps[i].timestamp = timestamp;
-        active_hold_taps[i].position_of_first_other_key_pressed = -1;
-        return &active_hold_taps[i];
+    int slot = zmk_position_slots_alloc(&hold_tap_slots, position);
+    if (slot < 0) {
+        return NULL;
     }
-    return NULL;
+
+    struct active_hold_tap *hold_tap = &active_hold_taps[slot];
+    hold_tap->position = position;
+    hold_tap->status = STATUS_UNDECIDED;
+    hold_tap->config = config;
+    hold_tap->param_hold = param_hold;
+    hold_tap->param_tap = param_tap;
+    hold_tap->timestamp = timestamp;
+    hold_tap->position_of_first_other_key_pressed = -1;
+    hold_tap->captured = false;
+    hold_tap->held_while_undecided = false;
+    return hold_tap;
+}
+
+// The timer work of the hold-tap is still in the event queue, the timer handler clears it up. A
+// new hold-tap can be stored for the position in the meantime.
+static void cancel_hold_tap(struct active_hold_tap *hold_tap) {
+    hold_tap->work_is_cancelled = true;
+    zmk_position_slots_unlink(&hold_tap_slots, hold_tap - active_hold_taps);
 }
 
 static void clear_hold_tap(struct active_hold_tap *hold_tap) {
-    hold_tap->position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
+    zmk_position_slots_free(&hold_tap_slots, hold_tap - active_hold_taps);
     hold_tap->status = STATUS_UNDECIDED;
     hold_tap->work_is_cancelled = false;
+    hold_tap->captured = false;
 }
 
 static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_moment event) {
@@ -357,47 +424,102 @@ static inline const char *decision_moment_str(enum decision_moment decision_mome
     }
 }
 
-static int press_binding(struct active_hold_tap *hold_tap) {
-    if (hold_tap->config->retro_tap && hold_tap->status == STATUS_HOLD_TIMER) {
-        return 0;
-    }
+static int press_hold_binding(struct active_hold_tap *hold_tap) {
+    struct zmk_behavior_binding_event event = {
+        .position = hold_tap->position,
+        .timestamp = hold_tap->timestamp,
+    };
 
+    struct zmk_behavior_binding binding = {
+        .behavior_local_id = hold_tap->config->hold_behavior_local_id,
+        .param1 = hold_tap->param_hold,
+    };
+    return behavior_keymap_binding_pressed(&binding, event);
+}
+
+static int press_tap_binding(struct active_hold_tap *hold_tap) {
     struct zmk_behavior_binding_event event = {
         .position = hold_tap->position,
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
-    if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
-        binding.param1 = hold_tap->param_hold;
-    } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
-        binding.param1 = hold_tap->param_tap;
-        store_last_hold_tapped(hold_tap);
-    }
+    struct zmk_behavior_binding binding = {
+        .behavior_local_id = hold_tap->config->tap_behavior_local_id,
+        .param1 = hold_tap->param_tap,
+    };
+    store_last_hold_tapped(hold_tap);
     return behavior_keymap_binding_pressed(&binding, event);
 }
 
-static int release_binding(struct active_hold_tap *hold_tap) {
-    if (hold_tap->config->retro_tap && hold_tap->status == STATUS_HOLD_TIMER) {
-        return 0;
-    }
+static int release_hold_binding(struct active_hold_tap *hold_tap) {
+    struct zmk_behavior_binding_event event = {
+        .position = hold_tap->position,
+        .timestamp = hold_tap->timestamp,
+    };
 
+    struct zmk_behavior_binding binding = {
+        .behavior_local_id = hold_tap->config->hold_behavior_local_id,
+        .param1 = hold_tap->param_hold,
+    };
+    return behavior_keymap_binding_released(&binding, event);
+}
+
+static int release_tap_binding(struct active_hold_tap *hold_tap) {
     struct zmk_behavior_binding_event event = {
         .position = hold_tap->position,
         .timestamp = hold_tap->timestamp,
     };
 
-    struct zmk_behavior_binding binding = {0};
+    struct zmk_behavior_binding binding = {
+        .behavior_local_id = hold_tap->config->tap_behavior_local_id,
+        .param1 = hold_tap->param_tap,
+    };
+    return behavior_keymap_binding_released(&binding, event);
+}
+
+static int press_binding(struct active_hold_tap *hold_tap) {
+    if (hold_tap->config->retro_tap && hold_tap->status == STATUS_HOLD_TIMER) {
+        return 0;
+    }
+
     if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
-        binding.behavior_dev = hold_tap->config->hold_behavior_dev;
-        binding.param1 = hold_tap->param_hold;
-    } else {
-        binding.behavior_dev = hold_tap->config->tap_behavior_dev;
-        binding.param1 = hold_tap->param_tap;
+        if (hold_tap->held_while_undecided) {
+            // the hold behavior is already pressed
+            return 0;
+        }
+        return press_hold_binding(hold_tap);
     }
-    return behavior_keymap_binding_released(&binding, event);
+
+    if (hold_tap->held_while_undecided) {
+        // take back the hold behavior before the tap
+        hold_tap->held_while_undecided = false;
+        release_hold_binding(hold_tap);
+    }
+    return press_tap_binding(hold_tap);
+}
+
+static int release_binding(struct active_hold_tap *hold_tap) {
+    if (hold_tap->config->retro_tap && hold_tap->status == STATUS_HOLD_TIMER) {
+        return 0;
+    }
+
+    if (hold_tap->status == STATUS_HOLD_TIMER || hold_tap->status == STATUS_HOLD_INTERRUPT) {
+        return release_hold_binding(hold_tap);
+    }
+    return release_tap_binding(hold_tap);
+}
+
+// Presses the hold behavior of a hold-tap that is about to become the undecided hold-tap, so it
+// doesn't capture the events of its own hold behavior.
+static void press_hold_while_undecided(struct active_hold_tap *hold_tap) {
+    if (!hold_tap->config->hold_while_undecided || hold_tap->status != STATUS_UNDECIDED ||
+        is_quick_tap(hold_tap)) {
+        return;
+    }
+
+    LOG_DBG("%d hold while undecided", hold_tap->position);
+    hold_tap->held_while_undecided = true;
+    press_hold_binding(hold_tap);
 }
 
 static bool is_first_other_key_pressed_trigger_key(struct active_hold_tap *hold_tap) {
@@ -439,7 +561,7 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
         return;
     }
 
-    if (hold_tap != undecided_hold_tap) {
+    if (hold_tap != undecided_hold_tap && !hold_tap->captured) {
         LOG_DBG("ERROR found undecided tap hold that is not the active tap hold");
         return;
     }
@@ -471,11 +593,121 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
     LOG_DBG("%d decided %s (%s decision moment %s)", hold_tap->position,
             status_str(hold_tap->status), flavor_str(hold_tap->config->flavor),
             decision_moment_str(decision_moment));
+    if (hold_tap->captured) {
+        // pressed when its key-down is released
+        return;
+    }
     undecided_hold_tap = NULL;
     press_binding(hold_tap);
     release_captured_events();
 }
 
+static void schedule_hold_tap_timer(struct active_hold_tap *hold_tap) {
+    // if this behavior was queued we have to adjust the timer to only
+    // wait for the remaining time.
+    int32_t tapping_term_ms_left =
+        (hold_tap->timestamp + hold_tap->config->tapping_term_ms) - k_uptime_get();
+    k_work_schedule(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+}
+
+// Starts deciding a hold-tap whose key-down was just captured, instead of waiting until the
+// undecided hold-tap releases it. The binding is looked up with the current layer state; if the
+// keymap ends up invoking something else once the key-down is released, it is discarded again.
+static void store_captured_hold_tap(struct zmk_position_state_changed *ev, uint32_t seq) {
+    struct active_hold_tap *hold_tap = find_captured_hold_tap(ev->position);
+    if (hold_tap != NULL) {
+        // captured again while it was being released by an earlier hold-tap
+        hold_tap->captured_seq = seq;
+        return;
+    }
+
+    const struct device *behavior = NULL;
+    const struct zmk_behavior_binding *binding =
+        zmk_keymap_position_binding(ev->position, &behavior);
+    if (binding == NULL || behavior == NULL || behavior->api != &behavior_hold_tap_driver_api) {
+        return;
+    }
+
+    hold_tap = store_hold_tap(ev->position, binding->param1, binding->param2, ev->timestamp,
+                              behavior->config);
+    if (hold_tap == NULL) {
+        // it will be stored when its key-down is released, if there is room by then
+        return;
+    }
+
+    LOG_DBG("%d new captured hold_tap", ev->position);
+    hold_tap->captured = true;
+    hold_tap->captured_seq = seq;
+    schedule_hold_tap_timer(hold_tap);
+}
+
+// Called after a captured key-down has been released. If it belonged to a captured hold-tap that
+// wasn't picked up by its binding, and wasn't captured again, the keymap invoked something else.
+static void discard_captured_hold_tap(uint32_t seq) {
+    ZMK_POSITION_SLOTS_FOREACH(&hold_tap_slots, i) {
+        struct active_hold_tap *hold_tap = &active_hold_taps[i];
+        if (!hold_tap->captured || hold_tap->captured_seq != seq) {
+            continue;
+        }
+
+        LOG_DBG("%d discarding captured hold_tap", hold_tap->position);
+        hold_tap->captured = false;
+        if (k_work_cancel_delayable(&hold_tap->work) == -EINPROGRESS) {
+            cancel_hold_tap(hold_tap);
+        } else {
+            clear_hold_tap(hold_tap);
+        }
+    }
+}
+
+// Decides the captured hold-taps on a position event the undecided hold-tap is about to capture,
+// as if they were undecided themselves when it is released.
+static void decide_captured_hold_taps(struct zmk_position_state_changed *ev) {
+    ZMK_POSITION_SLOTS_FOREACH(&hold_tap_slots, i) {
+        struct active_hold_tap *hold_tap = &active_hold_taps[i];
+        // hold-taps still being released by an earlier hold-tap have already seen this event
+        if (!hold_tap->captured || hold_tap->status != STATUS_UNDECIDED ||
+            !is_captured_by_undecided(hold_tap->captured_seq)) {
+            continue;
+        }
+
+        if (ev->timestamp > (hold_tap->timestamp + hold_tap->config->tapping_term_ms)) {
+            decide_hold_tap(hold_tap, HT_TIMER_EVENT);
+        }
+
+        if (hold_tap->position == ev->position) {
+            if (!ev->state) {
+                decide_hold_tap(hold_tap, HT_KEY_UP);
+            }
+            continue;
+        }
+
+        if (ev->state) {
+            if (hold_tap->position_of_first_other_key_pressed == -1) {
+                hold_tap->position_of_first_other_key_pressed = ev->position;
+            }
+            decide_hold_tap(hold_tap, HT_OTHER_KEY_DOWN);
+        } else if (ev->position < ZMK_KEYMAP_LEN &&
+                   is_captured_by_undecided(captured_keydowns[ev->position]) &&
+                   captured_keydowns[ev->position] - hold_tap->captured_seq <
+                       captured_events_tail - hold_tap->captured_seq) {
+            // the key went down after the hold-tap's key-down
+            decide_hold_tap(hold_tap, HT_OTHER_KEY_UP);
+        }
+    }
+}
+
+// Called when the undecided hold-tap can't capture any more events. Decides it as if its tapping
+// term ran out, which releases the captured events in order.
+static void spill_captured_events() {
+    // Releasing the events can make a captured hold-tap the new undecided one, while the buffer
+    // is still full, so keep deciding until there is room or nothing is left to capture them.
+    while (undecided_hold_tap != NULL && captured_events_full()) {
+        LOG_WRN("%d captured too many events, deciding early", undecided_hold_tap->position);
+        decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
+    }
+}
+
 static void decide_retro_tap(struct active_hold_tap *hold_tap) {
     if (!hold_tap->config->retro_tap) {
         return;
@@ -490,11 +722,10 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
 }
 
 static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
+    ZMK_POSITION_SLOTS_FOREACH(&hold_tap_slots, i) {
         struct active_hold_tap *hold_tap = &active_hold_taps[i];
-        if (hold_tap->position == ignore_position ||
-            hold_tap->position == ZMK_BHV_HOLD_TAP_POSITION_NOT_USED ||
-            hold_tap->config->retro_tap == false) {
+        if (hold_tap->position == ignore_position || hold_tap->config->retro_tap == false ||
+            hold_tap->captured) {
             continue;
         }
         if (hold_tap->status == STATUS_HOLD_TIMER) {
@@ -505,9 +736,33 @@ static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
     }
 }
 
+// The key-down of a captured hold-tap has been released to its binding. It may have been decided
+// already, in which case its behavior is pressed right away, and its timer is already running.
+static int press_captured_hold_tap(struct active_hold_tap *hold_tap) {
+    hold_tap->captured = false;
+    press_hold_while_undecided(hold_tap);
+    undecided_hold_tap = hold_tap;
+
+    // quick taps depend on what was tapped before it, which is only known now
+    if (is_quick_tap(hold_tap)) {
+        hold_tap->status = STATUS_UNDECIDED;
+        decide_hold_tap(hold_tap, HT_QUICK_TAP);
+        return ZMK_BEHAVIOR_OPAQUE;
+    }
+
+    if (hold_tap->status == STATUS_UNDECIDED) {
+        return ZMK_BEHAVIOR_OPAQUE;
+    }
+
+    LOG_DBG("%d already decided %s", hold_tap->position, status_str(hold_tap->status));
+    undecided_hold_tap = NULL;
+    press_binding(hold_tap);
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
 static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     const struct behavior_hold_tap_config *cfg = dev->config;
 
     if (undecided_hold_tap != NULL) {
@@ -516,7 +771,17 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
         return ZMK_BEHAVIOR_OPAQUE;
     }
 
-    struct active_hold_tap *hold_tap =
+    struct active_hold_tap *hold_tap = find_captured_hold_tap(event.position);
+    if (hold_tap != NULL) {
+        if (hold_tap->config == cfg && hold_tap->timestamp == event.timestamp &&
+            hold_tap->param_hold == binding->param1 && hold_tap->param_tap == binding->param2) {
+            LOG_DBG("%d new undecided hold_tap", event.position);
+            return press_captured_hold_tap(hold_tap);
+        }
+        discard_captured_hold_tap(hold_tap->captured_seq);
+    }
+
+    hold_tap =
         store_hold_tap(event.position, binding->param1, binding->param2, event.timestamp, cfg);
     if (hold_tap == NULL) {
         LOG_ERR("unable to store hold-tap info, did you press more than %d hold-taps?",
@@ -525,16 +790,14 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
     }
 
     LOG_DBG("%d new undecided hold_tap", event.position);
+    press_hold_while_undecided(hold_tap);
     undecided_hold_tap = hold_tap;
 
     if (is_quick_tap(hold_tap)) {
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
     }
 
-    // if this behavior was queued we have to adjust the timer to only
-    // wait for the remaining time.
-    int32_t tapping_term_ms_left = (hold_tap->timestamp + cfg->tapping_term_ms) - k_uptime_get();
-    k_work_schedule(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+    schedule_hold_tap_timer(hold_tap);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -562,7 +825,7 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
         // let the timer handler clean up
         // if we'd clear now, the timer may call back for an uninitialized active_hold_tap.
         LOG_DBG("%d hold-tap timer work in event queue", event.position);
-        hold_tap->work_is_cancelled = true;
+        cancel_hold_tap(hold_tap);
     } else {
         LOG_DBG("%d cleaning up hold-tap", event.position);
         clear_hold_tap(hold_tap);
@@ -581,6 +844,10 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     update_hold_status_for_retro_tap(ev->position);
 
+    if (undecided_hold_tap != NULL && captured_events_full()) {
+        spill_captured_events();
+    }
+
     if (undecided_hold_tap == NULL) {
         LOG_DBG("%d bubble (no undecided hold_tap active)", ev->position);
         return ZMK_EV_EVENT_BUBBLE;
@@ -610,6 +877,10 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
     if (ev->timestamp >
         (undecided_hold_tap->timestamp + undecided_hold_tap->config->tapping_term_ms)) {
         decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
+        if (undecided_hold_tap == NULL) {
+            LOG_DBG("%d bubble (no undecided hold_tap active)", ev->position);
+            return ZMK_EV_EVENT_BUBBLE;
+        }
     }
 
     if (!ev->state && find_captured_keydown_event(ev->position) == NULL) {
@@ -622,7 +893,11 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
+    decide_captured_hold_taps(ev);
     capture_event(eh);
+    if (ev->state) {
+        store_captured_hold_tap(ev, captured_events_tail - 1);
+    }
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -635,6 +910,10 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
         store_last_tapped(ev->timestamp);
     }
 
+    if (undecided_hold_tap != NULL && captured_events_full()) {
+        spill_captured_events();
+    }
+
     if (undecided_hold_tap == NULL) {
         // LOG_DBG("0x%02X bubble (no undecided hold_tap active)", ev->keycode);
         return ZMK_EV_EVENT_BUBBLE;
@@ -683,7 +962,6 @@ static int behavior_hold_tap_init(const struct device *dev) {
     if (init_first_run) {
         for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
             k_work_init_delayable(&active_hold_taps[i].work, behavior_hold_tap_timer_work_handler);
-            active_hold_taps[i].position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
         }
     }
     init_first_run = false;
@@ -693,18 +971,20 @@ static int behavior_hold_tap_init(const struct device *dev) {
 #define KP_INST(n)                                                                                 \
     static struct behavior_hold_tap_config behavior_hold_tap_config_##n = {                        \
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
-        .hold_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 0)),                     \
-        .tap_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 1)),                      \
+        .hold_behavior_local_id = ZMK_BEHAVIOR_LOCAL_ID(DT_INST_PHANDLE_BY_IDX(n, bindings, 0)),   \
+        .tap_behavior_local_id = ZMK_BEHAVIOR_LOCAL_ID(DT_INST_PHANDLE_BY_IDX(n, bindings, 1)),    \
         .quick_tap_ms = DT_INST_PROP(n, quick_tap_ms),                                             \
+        .require_prior_idle_ms = DT_INST_PROP(n, require_prior_idle_ms),                           \
         .global_quick_tap = DT_INST_PROP(n, global_quick_tap),                                     \
         .flavor = DT_ENUM_IDX(DT_DRV_INST(n), flavor),                                             \
         .retro_tap = DT_INST_PROP(n, retro_tap),                                                   \
+        .hold_while_undecided = DT_INST_PROP(n, hold_while_undecided),                             \
         .hold_trigger_key_positions = DT_INST_PROP(n, hold_trigger_key_positions),                 \
         .hold_trigger_key_positions_len = DT_INST_PROP_LEN(n, hold_trigger_key_positions),         \
     };                                                                                             \
-    DEVICE_DT_INST_DEFINE(n, behavior_hold_tap_init, NULL, NULL, &behavior_hold_tap_config_##n,    \
-                          APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                        \
-                          &behavior_hold_tap_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_hold_tap_init, NULL, NULL, &behavior_hold_tap_config_##n,  \
+                            APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                      \
+                            &behavior_hold_tap_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
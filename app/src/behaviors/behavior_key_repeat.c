@@ -32,7 +32,7 @@ struct behavior_key_repeat_data {
 
 static int on_key_repeat_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     struct behavior_key_repeat_data *data = dev->data;
 
     if (data->last_keycode_pressed.usage_page == 0) {
@@ -50,7 +50,7 @@ static int on_key_repeat_binding_pressed(struct zmk_behavior_binding *binding,
 
 static int on_key_repeat_binding_released(struct zmk_behavior_binding *binding,
                                           struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     struct behavior_key_repeat_data *data = dev->data;
 
     if (data->current_keycode_pressed.usage_page == 0) {
@@ -116,9 +116,9 @@ static int behavior_key_repeat_init(const struct device *dev) {
         .usage_pages = DT_INST_PROP(n, usage_pages),                                               \
         .usage_pages_count = DT_INST_PROP_LEN(n, usage_pages),                                     \
     };                                                                                             \
-    DEVICE_DT_INST_DEFINE(n, behavior_key_repeat_init, NULL, &behavior_key_repeat_data_##n,        \
-                          &behavior_key_repeat_config_##n, APPLICATION,                            \
-                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_key_repeat_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_key_repeat_init, NULL, &behavior_key_repeat_data_##n,      \
+                            &behavior_key_repeat_config_##n, APPLICATION,                          \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_key_repeat_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KR_INST)
 
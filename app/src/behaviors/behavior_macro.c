@@ -27,55 +27,63 @@ struct behavior_macro_trigger_state {
     uint32_t wait_ms;
     uint32_t tap_ms;
     enum behavior_macro_mode mode;
-    uint16_t start_index;
-    uint16_t count;
 };
 
-struct behavior_macro_state {
-    struct behavior_macro_trigger_state release_state;
+// A binding to invoke, with the mode and timings of the control bindings before it folded in. The
+// binding itself is read from the macro's config, which stays in flash.
+struct behavior_macro_step {
+    uint16_t binding;
+    uint16_t tap_ms;
+    uint16_t wait_ms;
+    uint8_t mode;
+};
 
-    uint32_t press_bindings_count;
+struct behavior_macro_state {
+    // Compiled at init; the steps from release_start onwards are queued on release.
+    struct behavior_macro_step *steps;
+    uint16_t steps_count;
+    uint16_t release_start;
 };
 
 struct behavior_macro_config {
     uint32_t default_wait_ms;
     uint32_t default_tap_ms;
     uint32_t count;
-    struct zmk_behavior_binding bindings[];
+    const struct zmk_behavior_binding bindings[];
 };
 
-#define TAP_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_tap))
-#define PRESS_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_press))
-#define REL_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_release))
+#define TAP_MODE ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_control_mode_tap))
+#define PRESS_MODE ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_control_mode_press))
+#define REL_MODE ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_control_mode_release))
 
-#define TAP_TIME DT_LABEL(DT_INST(0, zmk_macro_control_tap_time))
-#define WAIT_TIME DT_LABEL(DT_INST(0, zmk_macro_control_wait_time))
-#define WAIT_REL DT_LABEL(DT_INST(0, zmk_macro_pause_for_release))
+#define TAP_TIME ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_control_tap_time))
+#define WAIT_TIME ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_control_wait_time))
+#define WAIT_REL ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_macro_pause_for_release))
 
-#define ZM_IS_NODE_MATCH(a, b) (strcmp(a, b) == 0)
-#define IS_TAP_MODE(dev) ZM_IS_NODE_MATCH(dev, TAP_MODE)
-#define IS_PRESS_MODE(dev) ZM_IS_NODE_MATCH(dev, PRESS_MODE)
-#define IS_RELEASE_MODE(dev) ZM_IS_NODE_MATCH(dev, REL_MODE)
+#define IS_TAP_MODE(id) ((id) == TAP_MODE)
+#define IS_PRESS_MODE(id) ((id) == PRESS_MODE)
+#define IS_RELEASE_MODE(id) ((id) == REL_MODE)
 
-#define IS_TAP_TIME(dev) ZM_IS_NODE_MATCH(dev, TAP_TIME)
-#define IS_WAIT_TIME(dev) ZM_IS_NODE_MATCH(dev, WAIT_TIME)
-#define IS_PAUSE(dev) ZM_IS_NODE_MATCH(dev, WAIT_REL)
+#define IS_TAP_TIME(id) ((id) == TAP_TIME)
+#define IS_WAIT_TIME(id) ((id) == WAIT_TIME)
+#define IS_PAUSE(id) ((id) == WAIT_REL)
 
 static bool handle_control_binding(struct behavior_macro_trigger_state *state,
+                                   zmk_behavior_local_id_t local_id,
                                    const struct zmk_behavior_binding *binding) {
-    if (IS_TAP_MODE(binding->behavior_dev)) {
+    if (IS_TAP_MODE(local_id)) {
         state->mode = MACRO_MODE_TAP;
         LOG_DBG("macro mode set: tap");
-    } else if (IS_PRESS_MODE(binding->behavior_dev)) {
+    } else if (IS_PRESS_MODE(local_id)) {
         state->mode = MACRO_MODE_PRESS;
         LOG_DBG("macro mode set: press");
-    } else if (IS_RELEASE_MODE(binding->behavior_dev)) {
+    } else if (IS_RELEASE_MODE(local_id)) {
         state->mode = MACRO_MODE_RELEASE;
         LOG_DBG("macro mode set: release");
-    } else if (IS_TAP_TIME(binding->behavior_dev)) {
+    } else if (IS_TAP_TIME(local_id)) {
         state->tap_ms = binding->param1;
         LOG_DBG("macro tap time set: %d", state->tap_ms);
-    } else if (IS_WAIT_TIME(binding->behavior_dev)) {
+    } else if (IS_WAIT_TIME(local_id)) {
         state->wait_ms = binding->param1;
         LOG_DBG("macro wait time set: %d", state->wait_ms);
     } else {
@@ -85,78 +93,117 @@ static bool handle_control_binding(struct behavior_macro_trigger_state *state,
     return true;
 }
 
+static uint16_t step_time_ms(uint32_t ms) {
+    if (ms > UINT16_MAX) {
+        LOG_WRN("Macro time %dms is too long, using %dms", ms, UINT16_MAX);
+        return UINT16_MAX;
+    }
+
+    return ms;
+}
+
+static void add_step(struct behavior_macro_state *state, int binding,
+                     const struct behavior_macro_trigger_state *trigger_state) {
+    state->steps[state->steps_count++] = (struct behavior_macro_step){
+        .binding = binding,
+        .mode = trigger_state->mode,
+        .tap_ms = step_time_ms(trigger_state->tap_ms),
+        .wait_ms = step_time_ms(trigger_state->wait_ms),
+    };
+}
+
 static int behavior_macro_init(const struct device *dev) {
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
-    state->press_bindings_count = cfg->count;
-    state->release_state.start_index = cfg->count;
-    state->release_state.count = 0;
-
-    LOG_DBG("Precalculate initial release state:");
+    struct behavior_macro_trigger_state press_state = {.mode = MACRO_MODE_TAP,
+                                                       .tap_ms = cfg->default_tap_ms,
+                                                       .wait_ms = cfg->default_wait_ms};
+    // The release part resumes with the control bindings of the press part applied, on top of a
+    // zeroed state rather than the defaults.
+    struct behavior_macro_trigger_state release_state = {.mode = MACRO_MODE_TAP};
+    bool paused = false;
+
+    state->steps_count = 0;
+    state->release_start = 0;
+
+    LOG_DBG("Compiling macro steps:");
     for (int i = 0; i < cfg->count; i++) {
-        if (handle_control_binding(&state->release_state, &cfg->bindings[i])) {
-            // Updated state used for initial state on release.
-        } else if (IS_PAUSE(cfg->bindings[i].behavior_dev)) {
-            state->release_state.start_index = i + 1;
-            state->release_state.count = cfg->count - state->release_state.start_index;
-            state->press_bindings_count = i;
-            LOG_DBG("Release will resume at %d", state->release_state.start_index);
-            break;
-        } else {
-            // Ignore regular invokable bindings
+        const struct zmk_behavior_binding *binding = &cfg->bindings[i];
+        const zmk_behavior_local_id_t local_id = binding->behavior_local_id;
+        const bool is_control = handle_control_binding(paused ? &release_state : &press_state,
+                                                       local_id, binding);
+
+        if (is_control) {
+            if (!paused) {
+                handle_control_binding(&release_state, local_id, binding);
+            }
+            continue;
         }
+
+        if (!paused && IS_PAUSE(local_id)) {
+            paused = true;
+            state->release_start = state->steps_count;
+            LOG_DBG("Release will resume at step %d", state->release_start);
+            continue;
+        }
+
+        // The control behaviors have no driver, only the bindings invoked by the macro resolve.
+        if (zmk_behavior_get_by_local_id(local_id) == NULL) {
+            LOG_ERR("Unable to resolve macro binding %d, skipping it", i);
+            continue;
+        }
+
+        add_step(state, i, paused ? &release_state : &press_state);
+    }
+
+    if (!paused) {
+        state->release_start = state->steps_count;
     }
 
     return 0;
 };
 
-static void queue_macro(uint32_t position, const struct zmk_behavior_binding bindings[],
-                        struct behavior_macro_trigger_state state) {
-    LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
-    for (int i = state.start_index; i < state.start_index + state.count; i++) {
-        if (!handle_control_binding(&state, &bindings[i])) {
-            switch (state.mode) {
-            case MACRO_MODE_TAP:
-                zmk_behavior_queue_add(position, bindings[i], true, state.tap_ms);
-                zmk_behavior_queue_add(position, bindings[i], false, state.wait_ms);
-                break;
-            case MACRO_MODE_PRESS:
-                zmk_behavior_queue_add(position, bindings[i], true, state.wait_ms);
-                break;
-            case MACRO_MODE_RELEASE:
-                zmk_behavior_queue_add(position, bindings[i], false, state.wait_ms);
-                break;
-            default:
-                LOG_ERR("Unknown macro mode: %d", state.mode);
-                break;
-            }
+static void queue_macro(uint32_t position, const struct behavior_macro_config *cfg,
+                        const struct behavior_macro_step steps[], int start, int count) {
+    LOG_DBG("Queueing macro steps - starting: %d, count: %d", start, count);
+    for (const struct behavior_macro_step *step = &steps[start]; step < &steps[start + count];
+         step++) {
+        const struct zmk_behavior_binding *binding = &cfg->bindings[step->binding];
+
+        switch (step->mode) {
+        case MACRO_MODE_TAP:
+            zmk_behavior_queue_add_tap(position, binding, step->tap_ms, step->wait_ms);
+            break;
+        case MACRO_MODE_PRESS:
+            zmk_behavior_queue_add(position, binding, true, step->wait_ms);
+            break;
+        case MACRO_MODE_RELEASE:
+            zmk_behavior_queue_add(position, binding, false, step->wait_ms);
+            break;
+        default:
+            LOG_ERR("Unknown macro mode: %d", step->mode);
+            break;
         }
     }
 }
 
 static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                     struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
-    const struct behavior_macro_config *cfg = dev->config;
-    struct behavior_macro_state *state = dev->data;
-    struct behavior_macro_trigger_state trigger_state = {.mode = MACRO_MODE_TAP,
-                                                         .tap_ms = cfg->default_tap_ms,
-                                                         .wait_ms = cfg->default_wait_ms,
-                                                         .start_index = 0,
-                                                         .count = state->press_bindings_count};
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+    const struct behavior_macro_state *state = dev->data;
 
-    queue_macro(event.position, cfg->bindings, trigger_state);
+    queue_macro(event.position, dev->config, state->steps, 0, state->release_start);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
 
 static int on_macro_binding_released(struct zmk_behavior_binding *binding,
                                      struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
-    const struct behavior_macro_config *cfg = dev->config;
-    struct behavior_macro_state *state = dev->data;
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+    const struct behavior_macro_state *state = dev->data;
 
-    queue_macro(event.position, cfg->bindings, state->release_state);
+    queue_macro(event.position, dev->config, state->steps, state->release_start,
+                state->steps_count - state->release_start);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -172,15 +219,18 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
     {UTIL_LISTIFY(DT_PROP_LEN(DT_DRV_INST(n), bindings), BINDING_WITH_COMMA, n)},
 
 #define MACRO_INST(n)                                                                              \
-    static struct behavior_macro_state behavior_macro_state_##n = {};                              \
-    static struct behavior_macro_config behavior_macro_config_##n = {                              \
+    BUILD_ASSERT(DT_INST_PROP_LEN(n, bindings) <= UINT16_MAX, "Macro has too many bindings");      \
+    static struct behavior_macro_step behavior_macro_steps_##n[DT_INST_PROP_LEN(n, bindings)];     \
+    static struct behavior_macro_state behavior_macro_state_##n = {                                \
+        .steps = behavior_macro_steps_##n};                                                        \
+    static const struct behavior_macro_config behavior_macro_config_##n = {                        \
         .default_wait_ms = DT_INST_PROP_OR(n, wait_ms, 100),                                       \
         .default_tap_ms = DT_INST_PROP_OR(n, tap_ms, 100),                                         \
         .count = DT_INST_PROP_LEN(n, bindings),                                                    \
         .bindings = TRANSFORMED_BEHAVIORS(n)};                                                     \
-    DEVICE_DT_INST_DEFINE(n, behavior_macro_init, NULL, &behavior_macro_state_##n,                 \
-                          &behavior_macro_config_##n, APPLICATION,                                 \
-                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_macro_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_macro_init, NULL, &behavior_macro_state_##n,               \
+                            &behavior_macro_config_##n, APPLICATION,                               \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_macro_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(MACRO_INST)
 
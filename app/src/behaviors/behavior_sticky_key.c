@@ -19,15 +19,22 @@
 #include <zmk/events/modifiers_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
+#include <zmk/position_slots.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_STICKY_KEY_MAX_HELD 10
+#define ZMK_BHV_STICKY_KEY_MAX_HELD CONFIG_ZMK_BEHAVIOR_STICKY_KEY_MAX_HELD
 
 #define ZMK_BHV_STICKY_KEY_POSITION_FREE UINT32_MAX
 
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_key_press)
+#define KEY_PRESS_LOCAL_ID ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_behavior_key_press))
+#else
+#define KEY_PRESS_LOCAL_ID ZMK_BEHAVIOR_LOCAL_ID_NONE
+#endif
+
 struct behavior_sticky_key_config {
     uint32_t release_after_ms;
     bool quick_release;
@@ -51,47 +58,72 @@ struct active_sticky_key {
 };
 
 struct active_sticky_key active_sticky_keys[ZMK_BHV_STICKY_KEY_MAX_HELD] = {};
+// the slots of active_sticky_keys in use, and which one belongs to each key position
+ZMK_POSITION_SLOTS_DEFINE(sticky_key_slots, ZMK_BHV_STICKY_KEY_MAX_HELD);
+
+static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh);
+
+ZMK_LISTENER(behavior_sticky_key, sticky_key_keycode_state_changed_listener);
+ZMK_SUBSCRIPTION(behavior_sticky_key, zmk_keycode_state_changed);
 
 static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t param1,
                                                   uint32_t param2,
                                                   const struct behavior_sticky_key_config *config) {
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        struct active_sticky_key *const sticky_key = &active_sticky_keys[i];
-        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE ||
-            sticky_key->timer_cancelled) {
-            continue;
-        }
-        sticky_key->position = position;
-        sticky_key->param1 = param1;
-        sticky_key->param2 = param2;
-        sticky_key->config = config;
-        sticky_key->release_at = 0;
-        sticky_key->timer_cancelled = false;
-        sticky_key->timer_started = false;
-        sticky_key->modified_key_usage_page = 0;
-        sticky_key->modified_key_keycode = 0;
-        return sticky_key;
+    int slot = zmk_position_slots_alloc(&sticky_key_slots, position);
+    if (slot < 0) {
+        return NULL;
     }
-    return NULL;
+
+    struct active_sticky_key *const sticky_key = &active_sticky_keys[slot];
+    sticky_key->position = position;
+    sticky_key->param1 = param1;
+    sticky_key->param2 = param2;
+    sticky_key->config = config;
+    sticky_key->release_at = 0;
+    sticky_key->timer_cancelled = false;
+    sticky_key->timer_started = false;
+    sticky_key->modified_key_usage_page = 0;
+    sticky_key->modified_key_keycode = 0;
+    ZMK_SUBSCRIPTION_ENABLE(behavior_sticky_key, zmk_keycode_state_changed);
+    return sticky_key;
+}
+
+static void free_sticky_key_slot(int slot) {
+    zmk_position_slots_free(&sticky_key_slots, slot);
+
+    if (!zmk_position_slots_is_empty(&sticky_key_slots)) {
+        return;
+    }
+
+    // Keycodes only matter while a sticky key is active.
+    ZMK_SUBSCRIPTION_DISABLE(behavior_sticky_key, zmk_keycode_state_changed);
 }
 
 static void clear_sticky_key(struct active_sticky_key *sticky_key) {
+    int slot = sticky_key - active_sticky_keys;
+
     sticky_key->position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
+    if (sticky_key->timer_cancelled) {
+        // the slot is freed once the timer handler has run
+        zmk_position_slots_unlink(&sticky_key_slots, slot);
+        return;
+    }
+
+    free_sticky_key_slot(slot);
 }
 
 static struct active_sticky_key *find_sticky_key(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        if (active_sticky_keys[i].position == position && !active_sticky_keys[i].timer_cancelled) {
-            return &active_sticky_keys[i];
-        }
+    int slot = zmk_position_slots_find(&sticky_key_slots, position);
+    if (slot < 0 || active_sticky_keys[slot].timer_cancelled) {
+        return NULL;
     }
-    return NULL;
+    return &active_sticky_keys[slot];
 }
 
 static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                             int64_t timestamp) {
     struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
+        .behavior_local_id = sticky_key->config->behavior.behavior_local_id,
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
     };
@@ -105,7 +137,7 @@ static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key
 static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_key,
                                               int64_t timestamp) {
     struct zmk_behavior_binding binding = {
-        .behavior_dev = sticky_key->config->behavior.behavior_dev,
+        .behavior_local_id = sticky_key->config->behavior.behavior_local_id,
         .param1 = sticky_key->param1,
         .param2 = sticky_key->param2,
     };
@@ -129,7 +161,7 @@ static int stop_timer(struct active_sticky_key *sticky_key) {
 
 static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     const struct behavior_sticky_key_config *cfg = dev->config;
     struct active_sticky_key *sticky_key;
     sticky_key = find_sticky_key(event.position);
@@ -178,11 +210,6 @@ static const struct behavior_driver_api behavior_sticky_key_driver_api = {
     .binding_released = on_sticky_key_binding_released,
 };
 
-static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh);
-
-ZMK_LISTENER(behavior_sticky_key, sticky_key_keycode_state_changed_listener);
-ZMK_SUBSCRIPTION(behavior_sticky_key, zmk_keycode_state_changed);
-
 static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
     if (ev == NULL) {
@@ -191,13 +218,13 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
 
     // keep track whether the event has been reraised, so we only reraise it once
     bool event_reraised = false;
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
+    ZMK_POSITION_SLOTS_FOREACH(&sticky_key_slots, i) {
         struct active_sticky_key *sticky_key = &active_sticky_keys[i];
         if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
             continue;
         }
 
-        if (strcmp(sticky_key->config->behavior.behavior_dev, "KEY_PRESS") == 0 &&
+        if (sticky_key->config->behavior.behavior_local_id == KEY_PRESS_LOCAL_ID &&
             ZMK_HID_USAGE_ID(sticky_key->param1) == ev->keycode &&
             (ZMK_HID_USAGE_PAGE(sticky_key->param1) & 0xFF) == ev->usage_page &&
             SELECT_MODS(sticky_key->param1) == ev->implicit_modifiers) {
@@ -255,6 +282,11 @@ void behavior_sticky_key_timer_handler(struct k_work *item) {
     struct active_sticky_key *sticky_key =
         CONTAINER_OF(item, struct active_sticky_key, release_timer);
     if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
+        if (sticky_key->timer_cancelled) {
+            // released while the timer was running, so the slot was left for us to free
+            sticky_key->timer_cancelled = false;
+            free_sticky_key_slot(sticky_key - active_sticky_keys);
+        }
         return;
     }
     if (sticky_key->timer_cancelled) {
@@ -272,6 +304,7 @@ static int behavior_sticky_key_init(const struct device *dev) {
                                   behavior_sticky_key_timer_handler);
             active_sticky_keys[i].position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
         }
+        ZMK_SUBSCRIPTION_DISABLE(behavior_sticky_key, zmk_keycode_state_changed);
     }
     init_first_run = false;
     return 0;
@@ -287,9 +320,9 @@ static struct behavior_sticky_key_data behavior_sticky_key_data;
         .ignore_modifiers = DT_INST_PROP(n, ignore_modifiers),                                     \
         .quick_release = DT_INST_PROP(n, quick_release),                                           \
     };                                                                                             \
-    DEVICE_DT_INST_DEFINE(n, behavior_sticky_key_init, NULL, &behavior_sticky_key_data,            \
-                          &behavior_sticky_key_config_##n, APPLICATION,                            \
-                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_sticky_key_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_sticky_key_init, NULL, &behavior_sticky_key_data,          \
+                            &behavior_sticky_key_config_##n, APPLICATION,                          \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_sticky_key_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
@@ -12,6 +12,7 @@
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
 #include <zmk/matrix.h>
+#include <zmk/position_slots.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/keycode_state_changed.h>
@@ -21,7 +22,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_TAP_DANCE_MAX_HELD 10
+#define ZMK_BHV_TAP_DANCE_MAX_HELD CONFIG_ZMK_BEHAVIOR_TAP_DANCE_MAX_HELD
 
 #define ZMK_BHV_TAP_DANCE_POSITION_FREE UINT32_MAX
 
@@ -49,38 +50,51 @@ struct active_tap_dance {
 };
 
 struct active_tap_dance active_tap_dances[ZMK_BHV_TAP_DANCE_MAX_HELD] = {};
+// the slots of active_tap_dances in use, and which one belongs to each key position
+ZMK_POSITION_SLOTS_DEFINE(tap_dance_slots, ZMK_BHV_TAP_DANCE_MAX_HELD);
+
+static int tap_dance_position_state_changed_listener(const zmk_event_t *eh);
+
+ZMK_LISTENER(behavior_tap_dance, tap_dance_position_state_changed_listener);
+ZMK_SUBSCRIPTION(behavior_tap_dance, zmk_position_state_changed);
 
 static struct active_tap_dance *find_tap_dance(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        if (active_tap_dances[i].position == position && !active_tap_dances[i].timer_cancelled) {
-            return &active_tap_dances[i];
-        }
-    }
-    return NULL;
+    // tap dances whose timer was cancelled too late are unlinked from their position
+    int slot = zmk_position_slots_find(&tap_dance_slots, position);
+    return slot < 0 ? NULL : &active_tap_dances[slot];
 }
 
 static int new_tap_dance(uint32_t position, const struct behavior_tap_dance_config *config,
                          struct active_tap_dance **tap_dance) {
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        struct active_tap_dance *const ref_dance = &active_tap_dances[i];
-        if (ref_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
-            ref_dance->counter = 0;
-            ref_dance->position = position;
-            ref_dance->config = config;
-            ref_dance->release_at = 0;
-            ref_dance->is_pressed = true;
-            ref_dance->timer_started = true;
-            ref_dance->timer_cancelled = false;
-            ref_dance->tap_dance_decided = false;
-            *tap_dance = ref_dance;
-            return 0;
-        }
+    int slot = zmk_position_slots_alloc(&tap_dance_slots, position);
+    if (slot < 0) {
+        return -ENOMEM;
     }
-    return -ENOMEM;
+
+    struct active_tap_dance *const ref_dance = &active_tap_dances[slot];
+    ref_dance->counter = 0;
+    ref_dance->position = position;
+    ref_dance->config = config;
+    ref_dance->release_at = 0;
+    ref_dance->is_pressed = true;
+    ref_dance->timer_started = true;
+    ref_dance->timer_cancelled = false;
+    ref_dance->tap_dance_decided = false;
+    ZMK_SUBSCRIPTION_ENABLE(behavior_tap_dance, zmk_position_state_changed);
+    *tap_dance = ref_dance;
+    return 0;
 }
 
 static void clear_tap_dance(struct active_tap_dance *tap_dance) {
     tap_dance->position = ZMK_BHV_TAP_DANCE_POSITION_FREE;
+    zmk_position_slots_free(&tap_dance_slots, tap_dance - active_tap_dances);
+
+    if (!zmk_position_slots_is_empty(&tap_dance_slots)) {
+        return;
+    }
+
+    // Other key presses only matter while a tap dance can be interrupted.
+    ZMK_SUBSCRIPTION_DISABLE(behavior_tap_dance, zmk_position_state_changed);
 }
 
 static int stop_timer(struct active_tap_dance *tap_dance) {
@@ -88,6 +102,7 @@ static int stop_timer(struct active_tap_dance *tap_dance) {
     if (timer_cancel_result == -EINPROGRESS) {
         // too late to cancel, we'll let the timer handler clear up.
         tap_dance->timer_cancelled = true;
+        zmk_position_slots_unlink(&tap_dance_slots, tap_dance - active_tap_dances);
     }
     return timer_cancel_result;
 }
@@ -102,30 +117,46 @@ static void reset_timer(struct active_tap_dance *tap_dance,
     }
 }
 
-static inline int press_tap_dance_behavior(struct active_tap_dance *tap_dance, int64_t timestamp) {
-    tap_dance->tap_dance_decided = true;
-    struct zmk_behavior_binding binding = tap_dance->config->behaviors[tap_dance->counter - 1];
+static inline int invoke_tap_dance_behavior(const struct behavior_tap_dance_config *config,
+                                            int index, uint32_t position, int64_t timestamp,
+                                            bool pressed) {
+    struct zmk_behavior_binding binding = config->behaviors[index];
+    const struct device *behavior = zmk_behavior_get_by_local_id(binding.behavior_local_id);
     struct zmk_behavior_binding_event event = {
-        .position = tap_dance->position,
+        .position = position,
         .timestamp = timestamp,
     };
-    return behavior_keymap_binding_pressed(&binding, event);
+
+    if (behavior == NULL) {
+        LOG_ERR("Unable to find behavior with local ID %d", binding.behavior_local_id);
+        return -ENODEV;
+    }
+
+    if (pressed) {
+        return behavior_device_binding_pressed(behavior, &binding, event);
+    }
+    return behavior_device_binding_released(behavior, &binding, event);
+}
+
+static inline int press_tap_dance_behavior(struct active_tap_dance *tap_dance, int64_t timestamp) {
+    tap_dance->tap_dance_decided = true;
+    return invoke_tap_dance_behavior(tap_dance->config, tap_dance->counter - 1,
+                                     tap_dance->position, timestamp, true);
 }
 
 static inline int release_tap_dance_behavior(struct active_tap_dance *tap_dance,
                                              int64_t timestamp) {
-    struct zmk_behavior_binding binding = tap_dance->config->behaviors[tap_dance->counter - 1];
-    struct zmk_behavior_binding_event event = {
-        .position = tap_dance->position,
-        .timestamp = timestamp,
-    };
+    const struct behavior_tap_dance_config *config = tap_dance->config;
+    const int index = tap_dance->counter - 1;
+    const uint32_t position = tap_dance->position;
+
     clear_tap_dance(tap_dance);
-    return behavior_keymap_binding_released(&binding, event);
+    return invoke_tap_dance_behavior(config, index, position, timestamp, false);
 }
 
 static int on_tap_dance_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
-    const struct device *dev = device_get_binding(binding->behavior_dev);
+    const struct device *dev = zmk_behavior_get_by_local_id(binding->behavior_local_id);
     const struct behavior_tap_dance_config *cfg = dev->config;
     struct active_tap_dance *tap_dance;
     tap_dance = find_tap_dance(event.position);
@@ -174,6 +205,9 @@ void behavior_tap_dance_timer_handler(struct k_work *item) {
         return;
     }
     if (tap_dance->timer_cancelled) {
+        // cancelled too late, so the tap dance was unlinked and left for us to clear up
+        tap_dance->timer_cancelled = false;
+        clear_tap_dance(tap_dance);
         return;
     }
     LOG_DBG("Tap dance has been decided via timer. Counter reached: %d", tap_dance->counter);
@@ -189,11 +223,6 @@ static const struct behavior_driver_api behavior_tap_dance_driver_api = {
     .binding_released = on_tap_dance_binding_released,
 };
 
-static int tap_dance_position_state_changed_listener(const zmk_event_t *eh);
-
-ZMK_LISTENER(behavior_tap_dance, tap_dance_position_state_changed_listener);
-ZMK_SUBSCRIPTION(behavior_tap_dance, zmk_position_state_changed);
-
 static int tap_dance_position_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
     if (ev == NULL) {
@@ -203,11 +232,8 @@ static int tap_dance_position_state_changed_listener(const zmk_event_t *eh) {
         LOG_DBG("Ignore upstroke at position %d.", ev->position);
         return ZMK_EV_EVENT_BUBBLE;
     }
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
+    ZMK_POSITION_SLOTS_FOREACH(&tap_dance_slots, i) {
         struct active_tap_dance *tap_dance = &active_tap_dances[i];
-        if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
-            continue;
-        }
         if (tap_dance->position == ev->position) {
             continue;
         }
@@ -250,9 +276,9 @@ static int behavior_tap_dance_init(const struct device *dev) {
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
         .behaviors = behavior_tap_dance_config_##n##_bindings,                                     \
         .behavior_count = DT_INST_PROP_LEN(n, bindings)};                                          \
-    DEVICE_DT_INST_DEFINE(n, behavior_tap_dance_init, NULL, NULL, &behavior_tap_dance_config_##n,  \
-                          APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                        \
-                          &behavior_tap_dance_driver_api);
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_tap_dance_init, NULL, NULL,                                \
+                            &behavior_tap_dance_config_##n, APPLICATION,                           \
+                            CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_tap_dance_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
@@ -23,11 +23,45 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
+#define COMBO_POSITION_WORDS DIV_ROUND_UP(ZMK_KEYMAP_LEN, 32)
+
+// Everything below is sized from the devicetree: the number of combos, the total number of key
+// positions over all combos, and the key count of the longest combo.
+#define COMBO_ONE(n) +1
+#define COMBOS_LEN (0 DT_INST_FOREACH_CHILD(0, COMBO_ONE))
+#define COMBO_WORDS DIV_ROUND_UP(COMBOS_LEN, 32)
+
+// A combo on every layer is indexed once per key position; a combo limited to some layers is
+// indexed once per key position for each of its layers.
+#define COMBO_IS_GLOBAL(n) (DT_PROP_BY_IDX(n, layers, 0) == -1)
+#define COMBO_KEY_COUNT(n) +(COMBO_IS_GLOBAL(n) ? DT_PROP_LEN(n, key_positions) : 0)
+#define COMBO_LAYER_KEY_COUNT(n)                                                                   \
+    +(COMBO_IS_GLOBAL(n) ? 0 : DT_PROP_LEN(n, key_positions) * DT_PROP_LEN(n, layers))
+#define COMBO_KEYS_TOTAL                                                                           \
+    (0 DT_INST_FOREACH_CHILD(0, COMBO_KEY_COUNT) DT_INST_FOREACH_CHILD(0, COMBO_LAYER_KEY_COUNT))
+
+#define COMBO_PRIOR_IDLE_COUNT(n) +(DT_PROP(n, require_prior_idle_ms) > 0)
+#define COMBO_HAS_PRIOR_IDLE ((0 DT_INST_FOREACH_CHILD(0, COMBO_PRIOR_IDLE_COUNT)) > 0)
+
+#define COMBO_KEYS_MEMBER(n) uint8_t n[DT_PROP_LEN(n, key_positions)];
+union combo_max_keys {
+    DT_INST_FOREACH_CHILD(0, COMBO_KEYS_MEMBER)
+};
+#define COMBO_MAX_KEYS sizeof(union combo_max_keys)
+
+// Every active combo holds at least one pressed key, and a combo can't be activated again while
+// one of its keys is still held.
+#define COMBO_MAX_ACTIVE MIN(COMBOS_LEN, ZMK_KEYMAP_LEN)
+
 struct combo_cfg {
-    int32_t key_positions[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
+    const int32_t *key_positions;
     int32_t key_position_len;
+    // key_positions as a bitset, filled in at init
+    uint32_t position_mask[COMBO_POSITION_WORDS];
     struct zmk_behavior_binding behavior;
     int32_t timeout_ms;
+    // the combo is skipped if another key was pressed less than this long before its first key
+    int32_t require_prior_idle_ms;
     // if slow release is set, the combo releases when the last key is released.
     // otherwise, the combo releases when the first key is released.
     bool slow_release;
@@ -43,34 +77,94 @@ struct active_combo {
     // key_positions_pressed is filled with key_positions when the combo is pressed.
     // The keys are removed from this array when they are released.
     // Once this array is empty, the behavior is released.
-    const zmk_event_t *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
-};
-
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
+    const zmk_event_t *key_positions_pressed[COMBO_MAX_KEYS];
 };
 
 // set of keys pressed
-const zmk_event_t *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {NULL};
+const zmk_event_t *pressed_keys[COMBO_MAX_KEYS] = {NULL};
+// pressed_keys as a bitset of positions
+uint32_t pressed_positions[COMBO_POSITION_WORDS];
+// all combos, sorted shortest-first, then by virtual-key-position. Bit i of a combo set refers to
+// combos[i], so the lowest set bit is always the preferred combo.
+struct combo_cfg *combos[COMBOS_LEN];
+int combos_len = 0;
+// The rows of the combo index. Rows 0 to ZMK_KEYMAP_LEN - 1 hold the combos on every layer, by key
+// position. If any combo is limited to some layers, each layer gets a further ZMK_KEYMAP_LEN rows
+// holding the combos limited to it.
+#define COMBO_HAS_LAYER_COMBOS ((0 DT_INST_FOREACH_CHILD(0, COMBO_LAYER_KEY_COUNT)) > 0)
+#define COMBO_INDEX_ROWS                                                                           \
+    (ZMK_KEYMAP_LEN * (1 + (COMBO_HAS_LAYER_COMBOS ? ZMK_KEYMAP_LAYERS_LEN : 0)))
+#define COMBO_LAYER_ROW(layer, position) ((1 + (layer)) * ZMK_KEYMAP_LEN + (position))
+
+// a CSR index from rows to combos: the combos on row r are the entries of combo_index from
+// combo_index_offsets[r] up to, but not including, combo_index_offsets[r + 1].
+uint16_t combo_index_offsets[COMBO_INDEX_ROWS + 1];
+uint16_t combo_index[COMBO_KEYS_TOTAL];
+
+BUILD_ASSERT(COMBO_KEYS_TOTAL <= UINT16_MAX, "Too many combo key positions for the combo index");
 // the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+uint32_t candidates[COMBO_WORDS];
+// the time the first candidate key was pressed; each candidate times out timeout_ms after it.
+// by keeping track of when the candidates should be cleared there is no
+// possibility of accidental releases.
+int64_t candidates_pressed_at;
+// the candidates as a min-heap on timeout_ms, so the next one to time out is at the top. Combos
+// that stop being candidates are left in the heap and skipped once they reach the top.
+uint16_t candidate_heap[COMBOS_LEN];
+int candidate_heap_len = 0;
 // the last candidate that was completely pressed
 struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
 // combos that have been activated and still have (some) keys pressed
 // this array is always contiguous from 0.
-struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
+struct active_combo active_combos[COMBO_MAX_ACTIVE] = {NULL};
 int active_combo_count = 0;
 
+// the time the most recent key was pressed
+int64_t last_pressed_at = INT64_MIN;
+// the key down being re-raised by release_pressed_keys, and the time the key before it was pressed
+const zmk_event_t *reraised_event = NULL;
+int64_t reraised_prior_pressed_at;
+
 struct k_work_delayable timeout_task;
 int64_t timeout_task_timeout_at;
 
-// Store the combo key pointer in the combos array, one pointer for each key position
+// Iterates the indexes of the set bits; break behaves like continue.
+#define FOREACH_SET_BIT(set, words, idx)                                                           \
+    for (int _w = 0; _w < (words); _w++)                                                           \
+        for (uint32_t _bits = (set)[_w]; _bits != 0; _bits &= _bits - 1)                           \
+            for (int idx = _w * 32 + __builtin_ctz(_bits), _once = 1; _once; _once = 0)
+
+static inline bool combo_set_is_empty(const uint32_t *set) {
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        if (set[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline int combo_set_count(const uint32_t *set) {
+    int count = 0;
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        count += __builtin_popcount(set[i]);
+    }
+    return count;
+}
+
+static inline bool combo_set_contains(const uint32_t *set, int idx) {
+    return (set[idx / 32] & BIT(idx % 32)) != 0;
+}
+
+static inline struct combo_cfg *combo_set_first(const uint32_t *set) {
+    for (int i = 0; i < COMBO_WORDS; i++) {
+        if (set[i] != 0) {
+            return combos[i * 32 + __builtin_ctz(set[i])];
+        }
+    }
+    return NULL;
+}
+
+// Insert the combo into the sorted combos array.
 // The combos are sorted shortest-first, then by virtual-key-position.
 static int initialize_combo(struct combo_cfg *new_combo) {
     for (int i = 0; i < new_combo->key_position_len; i++) {
@@ -79,120 +173,186 @@ static int initialize_combo(struct combo_cfg *new_combo) {
             LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
             return -EINVAL;
         }
-
-        struct combo_cfg *insert_combo = new_combo;
-        bool set = false;
-        for (int j = 0; j < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; j++) {
-            struct combo_cfg *combo_at_j = combo_lookup[position][j];
-            if (combo_at_j == NULL) {
-                combo_lookup[position][j] = insert_combo;
-                set = true;
-                break;
-            }
-            if (combo_at_j->key_position_len < insert_combo->key_position_len ||
-                (combo_at_j->key_position_len == insert_combo->key_position_len &&
-                 combo_at_j->virtual_key_position < insert_combo->virtual_key_position)) {
-                continue;
+        new_combo->position_mask[position / 32] |= BIT(position % 32);
+    }
+    if (new_combo->layers[0] != -1) {
+        for (int i = 0; i < new_combo->layers_len; i++) {
+            if (new_combo->layers[i] < 0 || new_combo->layers[i] >= ZMK_KEYMAP_LAYERS_LEN) {
+                LOG_ERR("Unable to initialize combo, layer %d does not exist",
+                        new_combo->layers[i]);
+                return -EINVAL;
             }
-            // put insert_combo in this spot, move all other combos up.
-            combo_lookup[position][j] = insert_combo;
-            insert_combo = combo_at_j;
         }
-        if (!set) {
-            LOG_ERR("Too many combos for key position %d, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY %d.",
-                    position, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY);
-            return -ENOMEM;
+    }
+
+    int j = combos_len++;
+    for (; j > 0; j--) {
+        struct combo_cfg *combo_at_j = combos[j - 1];
+        if (combo_at_j->key_position_len < new_combo->key_position_len ||
+            (combo_at_j->key_position_len == new_combo->key_position_len &&
+             combo_at_j->virtual_key_position < new_combo->virtual_key_position)) {
+            break;
         }
+        combos[j] = combo_at_j;
     }
+    combos[j] = new_combo;
     return 0;
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
-    if (combo->layers[0] == -1) {
-        // -1 in the first layer position is global layer scope
-        return true;
-    }
-    for (int j = 0; j < combo->layers_len; j++) {
-        if (combo->layers[j] == layer) {
-            return true;
+typedef void (*combo_index_row_fn)(int row, int combo_idx);
+
+// Calls fn for every row of the combo index that the combo belongs to.
+static void foreach_combo_index_row(int combo_idx, combo_index_row_fn fn) {
+    struct combo_cfg *combo = combos[combo_idx];
+    for (int k = 0; k < combo->key_position_len; k++) {
+        if (combo->layers[0] == -1) {
+            // -1 in the first layer position is global layer scope
+            fn(combo->key_positions[k], combo_idx);
+            continue;
+        }
+        for (int l = 0; l < combo->layers_len; l++) {
+            fn(COMBO_LAYER_ROW(combo->layers[l], combo->key_positions[k]), combo_idx);
         }
     }
-    return false;
 }
 
-static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
-    int number_of_combo_candidates = 0;
-    uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_cfg *combo = combo_lookup[position][i];
-        if (combo == NULL) {
-            return number_of_combo_candidates;
+static void count_combo_index_row(int row, int combo_idx) { combo_index_offsets[row + 1]++; }
+
+static void fill_combo_index_row(int row, int combo_idx) {
+    combo_index[combo_index_offsets[row]++] = combo_idx;
+}
+
+static void initialize_combo_index() {
+    // count the combos on each row, then turn the counts into row offsets
+    for (int i = 0; i < combos_len; i++) {
+        foreach_combo_index_row(i, count_combo_index_row);
+    }
+    for (int r = 0; r < COMBO_INDEX_ROWS; r++) {
+        combo_index_offsets[r + 1] += combo_index_offsets[r];
+    }
+
+    // fill each row in combo order, using the start of each row as its cursor
+    for (int i = 0; i < combos_len; i++) {
+        foreach_combo_index_row(i, fill_combo_index_row);
+    }
+    // each cursor now points at the start of the next row; shift them back
+    for (int r = COMBO_INDEX_ROWS; r > 0; r--) {
+        combo_index_offsets[r] = combo_index_offsets[r - 1];
+    }
+    combo_index_offsets[0] = 0;
+}
+
+static inline void add_candidates_from_row(int row) {
+    for (int j = combo_index_offsets[row]; j < combo_index_offsets[row + 1]; j++) {
+        int i = combo_index[j];
+        candidates[i / 32] |= BIT(i % 32);
+    }
+}
+
+static inline bool is_quick_tap(struct combo_cfg *combo, int64_t prior_pressed_at,
+                                int64_t timestamp) {
+    return combo->require_prior_idle_ms > 0 &&
+           prior_pressed_at + combo->require_prior_idle_ms > timestamp;
+}
+
+static inline bool candidate_heap_less(int a, int b) {
+    return combos[candidate_heap[a]]->timeout_ms < combos[candidate_heap[b]]->timeout_ms;
+}
+
+static inline void candidate_heap_swap(int a, int b) {
+    uint16_t tmp = candidate_heap[a];
+    candidate_heap[a] = candidate_heap[b];
+    candidate_heap[b] = tmp;
+}
+
+static void candidate_heap_push(int combo_idx) {
+    int i = candidate_heap_len++;
+    candidate_heap[i] = combo_idx;
+    while (i > 0 && candidate_heap_less(i, (i - 1) / 2)) {
+        candidate_heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void candidate_heap_pop() {
+    candidate_heap[0] = candidate_heap[--candidate_heap_len];
+    for (int i = 0;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < candidate_heap_len && candidate_heap_less(left, smallest)) {
+            smallest = left;
         }
-        if (combo_active_on_layer(combo, highest_active_layer)) {
-            candidates[number_of_combo_candidates].combo = combo;
-            candidates[number_of_combo_candidates].timeout_at = timestamp + combo->timeout_ms;
-            number_of_combo_candidates++;
+        if (right < candidate_heap_len && candidate_heap_less(right, smallest)) {
+            smallest = right;
         }
-        // LOG_DBG("combo timeout %d %d %d", position, i, candidates[i].timeout_at);
+        if (smallest == i) {
+            return;
+        }
+        candidate_heap_swap(i, smallest);
+        i = smallest;
     }
-    return number_of_combo_candidates;
 }
 
-static int filter_candidates(int32_t position) {
-    // this code iterates over candidates and the lookup together to filter in O(n)
-    // assuming they are both sorted on key_position_len, virtal_key_position
-    int matches = 0, lookup_idx = 0, candidate_idx = 0;
-    while (lookup_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY &&
-           candidate_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
-        struct combo_cfg *candidate = candidates[candidate_idx].combo;
-        struct combo_cfg *lookup = combo_lookup[position][lookup_idx];
-        if (candidate == NULL || lookup == NULL) {
-            break;
+// returns the candidate that times out first, or -1 if there are no candidates.
+static int candidate_heap_peek() {
+    while (candidate_heap_len > 0) {
+        if (combo_set_contains(candidates, candidate_heap[0])) {
+            return candidate_heap[0];
         }
-        if (candidate->virtual_key_position == lookup->virtual_key_position) {
-            candidates[matches] = candidates[candidate_idx];
-            matches++;
-            candidate_idx++;
-            lookup_idx++;
-        } else if (candidate->key_position_len > lookup->key_position_len) {
-            lookup_idx++;
-        } else if (candidate->key_position_len < lookup->key_position_len) {
-            candidate_idx++;
-        } else if (candidate->virtual_key_position > lookup->virtual_key_position) {
-            lookup_idx++;
-        } else if (candidate->virtual_key_position < lookup->virtual_key_position) {
-            candidate_idx++;
+        candidate_heap_pop();
+    }
+    return -1;
+}
+
+static int setup_candidates_for_first_keypress(int32_t position, int64_t prior_pressed_at,
+                                               int64_t timestamp) {
+    // the index already holds the combos for each layer, so no filtering is needed here
+    add_candidates_from_row(position);
+    if (COMBO_HAS_LAYER_COMBOS) {
+        add_candidates_from_row(COMBO_LAYER_ROW(zmk_keymap_highest_layer_active(), position));
+    }
+    if (COMBO_HAS_PRIOR_IDLE) {
+        // while typing quickly, don't hold back keys for combos that need a pause before them
+        FOREACH_SET_BIT(candidates, COMBO_WORDS, i) {
+            if (is_quick_tap(combos[i], prior_pressed_at, timestamp)) {
+                candidates[i / 32] &= ~BIT(i % 32);
+            }
         }
     }
-    // clear unmatched candidates
-    for (int i = matches; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        candidates[i].combo = NULL;
+    candidate_heap_len = 0;
+    FOREACH_SET_BIT(candidates, COMBO_WORDS, i) {
+        candidate_heap_push(i);
     }
-    // LOG_DBG("combo matches after filter %d", matches);
-    return matches;
+    candidates_pressed_at = timestamp;
+    return combo_set_count(candidates);
 }
 
-static int64_t first_candidate_timeout() {
-    int64_t first_timeout = LONG_MAX;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            break;
-        }
-        if (candidates[i].timeout_at < first_timeout) {
-            first_timeout = candidates[i].timeout_at;
+static int filter_candidates(int32_t position) {
+    // a combo stays a candidate only if it contains every pressed key position
+    FOREACH_SET_BIT(candidates, COMBO_WORDS, i) {
+        if ((combos[i]->position_mask[position / 32] & BIT(position % 32)) == 0) {
+            candidates[i / 32] &= ~BIT(i % 32);
         }
     }
-    return first_timeout;
+    // LOG_DBG("combo matches after filter %d", combo_set_count(candidates));
+    return combo_set_count(candidates);
+}
+
+static int64_t first_candidate_timeout() {
+    int first = candidate_heap_peek();
+    if (first < 0) {
+        return LLONG_MAX;
+    }
+    return candidates_pressed_at + combos[first]->timeout_ms;
 }
 
 static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
-    // this code assumes set(pressed_keys) <= set(candidate->key_positions)
-    // this invariant is enforced by filter_candidates
     // since events may have been reraised after clearing one or more slots at
     // the start of pressed_keys (see: release_pressed_keys), we have to check
     // that each key needed to trigger the combo was pressed, not just the last.
-    for (int i = 0; i < candidate->key_position_len; i++) {
-        if (pressed_keys[i] == NULL) {
+    for (int i = 0; i < COMBO_POSITION_WORDS; i++) {
+        if ((candidate->position_mask[i] & ~pressed_positions[i]) != 0) {
             return false;
         }
     }
@@ -202,40 +362,30 @@ static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate)
 static int cleanup();
 
 static int filter_timed_out_candidates(int64_t timestamp) {
-    int num_candidates = 0;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_candidate *candidate = &candidates[i];
-        if (candidate->combo == NULL) {
-            break;
-        }
-        if (candidate->timeout_at > timestamp) {
-            // reorder candidates so they're contiguous
-            candidates[num_candidates].combo = candidate->combo;
-            candidates[num_candidates].timeout_at = candidates->timeout_at;
-            num_candidates++;
-        } else {
-            candidate->combo = NULL;
-        }
+    int i;
+    while ((i = candidate_heap_peek()) >= 0 &&
+           candidates_pressed_at + combos[i]->timeout_ms <= timestamp) {
+        candidates[i / 32] &= ~BIT(i % 32);
+        candidate_heap_pop();
     }
-    return num_candidates;
+    return combo_set_count(candidates);
 }
 
 static int clear_candidates() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            return i;
-        }
-        candidates[i].combo = NULL;
-    }
-    return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
+    int count = combo_set_count(candidates);
+    memset(candidates, 0, sizeof(candidates));
+    candidate_heap_len = 0;
+    return count;
 }
 
 static int capture_pressed_key(const zmk_event_t *ev) {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    for (int i = 0; i < COMBO_MAX_KEYS; i++) {
         if (pressed_keys[i] != NULL) {
             continue;
         }
         pressed_keys[i] = ev;
+        WRITE_BIT(pressed_positions[as_zmk_position_state_changed(ev)->position / 32],
+                  as_zmk_position_state_changed(ev)->position % 32, true);
         return ZMK_EV_EVENT_CAPTURED;
     }
     return 0;
@@ -244,12 +394,15 @@ static int capture_pressed_key(const zmk_event_t *ev) {
 const struct zmk_listener zmk_listener_combo;
 
 static int release_pressed_keys() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    memset(pressed_positions, 0, sizeof(pressed_positions));
+    int64_t prior_pressed_at = INT64_MIN;
+    for (int i = 0; i < COMBO_MAX_KEYS; i++) {
         const zmk_event_t *captured_event = pressed_keys[i];
         if (pressed_keys[i] == NULL) {
             return i;
         }
         pressed_keys[i] = NULL;
+        int64_t pressed_at = as_zmk_position_state_changed(captured_event)->timestamp;
         if (i == 0) {
             LOG_DBG("combo: releasing position event %d",
                     as_zmk_position_state_changed(captured_event)->position);
@@ -258,10 +411,14 @@ static int release_pressed_keys() {
             // reprocess events (see tests/combo/fully-overlapping-combos-3 for why this is needed)
             LOG_DBG("combo: reraising position event %d",
                     as_zmk_position_state_changed(captured_event)->position);
+            reraised_event = captured_event;
+            reraised_prior_pressed_at = prior_pressed_at;
             ZMK_EVENT_RAISE(captured_event);
+            reraised_event = NULL;
         }
+        prior_pressed_at = pressed_at;
     }
-    return CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO;
+    return COMBO_MAX_KEYS;
 }
 
 static inline int press_combo_behavior(struct combo_cfg *combo, int32_t timestamp) {
@@ -288,8 +445,11 @@ static void move_pressed_keys_to_active_combo(struct active_combo *active_combo)
         active_combo->key_positions_pressed[i] = pressed_keys[i];
         pressed_keys[i] = NULL;
     }
+    for (int i = 0; i < COMBO_POSITION_WORDS; i++) {
+        pressed_positions[i] &= ~active_combo->combo->position_mask[i];
+    }
     // move any other pressed keys up
-    for (int i = 0; i + combo_length < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
+    for (int i = 0; i + combo_length < COMBO_MAX_KEYS; i++) {
         if (pressed_keys[i + combo_length] == NULL) {
             return;
         }
@@ -299,16 +459,14 @@ static void move_pressed_keys_to_active_combo(struct active_combo *active_combo)
 }
 
 static struct active_combo *store_active_combo(struct combo_cfg *combo) {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS; i++) {
+    for (int i = 0; i < COMBO_MAX_ACTIVE; i++) {
         if (active_combos[i].combo == NULL) {
             active_combos[i].combo = combo;
             active_combo_count++;
             return &active_combos[i];
         }
     }
-    LOG_ERR("Unable to store combo; already %d active. Increase "
-            "CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS",
-            CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS);
+    LOG_ERR("Unable to store combo; already %d active", active_combo_count);
     return NULL;
 }
 
@@ -395,9 +553,22 @@ static void update_timeout_task() {
 }
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
+    int64_t prior_pressed_at;
+    if (ev == reraised_event) {
+        // already recorded the first time it came through, so idle time is measured from the key
+        // captured before it
+        prior_pressed_at = reraised_prior_pressed_at;
+    } else {
+        prior_pressed_at = last_pressed_at;
+        if (data->timestamp > last_pressed_at) {
+            last_pressed_at = data->timestamp;
+        }
+    }
+
     int num_candidates;
-    if (candidates[0].combo == NULL) {
-        num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
+    if (combo_set_is_empty(candidates)) {
+        num_candidates =
+            setup_candidates_for_first_keypress(data->position, prior_pressed_at, data->timestamp);
         if (num_candidates == 0) {
             return 0;
         }
@@ -407,7 +578,7 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     }
     update_timeout_task();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    struct combo_cfg *candidate_combo = combo_set_first(candidates);
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(ev);
     switch (num_candidates) {
@@ -470,9 +641,11 @@ ZMK_LISTENER(combo, position_state_changed_listener);
 ZMK_SUBSCRIPTION(combo, zmk_position_state_changed);
 
 #define COMBO_INST(n)                                                                              \
+    static const int32_t combo_key_positions_##n[] = DT_PROP(n, key_positions);                    \
     static struct combo_cfg combo_config_##n = {                                                   \
         .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
-        .key_positions = DT_PROP(n, key_positions),                                                \
+        .require_prior_idle_ms = DT_PROP(n, require_prior_idle_ms),                                \
+        .key_positions = combo_key_positions_##n,                                                  \
         .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
         .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
         .virtual_key_position = ZMK_KEYMAP_LEN + __COUNTER__,                                      \
@@ -488,6 +661,7 @@ DT_INST_FOREACH_CHILD(0, COMBO_INST)
 static int combo_init() {
     k_work_init_delayable(&timeout_task, combo_timeout_handler);
     DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
+    initialize_combo_index();
     return 0;
 }
 
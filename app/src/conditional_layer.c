@@ -30,7 +30,7 @@ struct conditional_layer_cfg {
     int8_t then_layer;
 };
 
-#define IF_LAYER_BIT(i, n) BIT(DT_PROP_BY_IDX(n, if_layers, i)) |
+#define IF_LAYER_BIT(i, n) ZMK_KEYMAP_LAYER_BIT(DT_PROP_BY_IDX(n, if_layers, i)) |
 
 // Evaluates to conditional_layer_cfg struct initializer.
 #define CONDITIONAL_LAYER_DECL(n)                                                                  \
@@ -47,41 +47,47 @@ static const struct conditional_layer_cfg CONDITIONAL_LAYER_CFGS[] = {
 static const int32_t NUM_CONDITIONAL_LAYER_CFGS =
     sizeof(CONDITIONAL_LAYER_CFGS) / sizeof(*CONDITIONAL_LAYER_CFGS);
 
-static void conditional_layer_activate(int8_t layer) {
-    // This may trigger another event that could, in turn, activate additional then-layers. However,
-    // the process will eventually terminate (at worst, when every layer is active).
-    if (!zmk_keymap_layer_active(layer)) {
+static void conditional_layer_activate(zmk_keymap_layers_state_t *layer_state, int8_t layer) {
+    if (!(*layer_state & ZMK_KEYMAP_LAYER_BIT(layer))) {
         LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_activate(layer);
+        *layer_state |= ZMK_KEYMAP_LAYER_BIT(layer);
     }
 }
 
-static void conditional_layer_deactivate(int8_t layer) {
+static void conditional_layer_deactivate(zmk_keymap_layers_state_t *layer_state, int8_t layer) {
     // This may deactivate a then-layer that's already active via another mechanism (e.g., a
     // momentary layer behavior). However, the same problem arises when multiple keys with the same
     // &mo binding are held and then one is released, so it's probably not an issue in practice.
-    if (zmk_keymap_layer_active(layer)) {
+    if (*layer_state & ZMK_KEYMAP_LAYER_BIT(layer)) {
         LOG_DBG("layer %d", layer);
-        zmk_keymap_layer_deactivate(layer);
+        *layer_state &= ~ZMK_KEYMAP_LAYER_BIT(layer);
     }
 }
 
 // On layer state changes, examines each conditional layer config to determine if then-layer in the
-// config should activate based on the currently active set of if-layers.
+// config should activate based on the currently active set of if-layers. All resulting changes are
+// applied together, so they raise a single layer state change.
 static int layer_state_changed_listener(const zmk_event_t *ev) {
+    zmk_keymap_layers_state_t layer_state = zmk_keymap_layer_state();
+
     for (int i = 0; i < NUM_CONDITIONAL_LAYER_CFGS; i++) {
         const struct conditional_layer_cfg *cfg = CONDITIONAL_LAYER_CFGS + i;
         zmk_keymap_layers_state_t mask = cfg->if_layers_state_mask;
 
         // Activate then-layer if and only if all if-layers are already active. Note that we
-        // reevaluate the current layer state for each config since activation of one layer can also
+        // reevaluate the layer state for each config since activation of one layer can also
         // trigger activation of another.
-        if ((zmk_keymap_layer_state() & mask) == mask) {
-            conditional_layer_activate(cfg->then_layer);
+        if ((layer_state & mask) == mask) {
+            conditional_layer_activate(&layer_state, cfg->then_layer);
         } else {
-            conditional_layer_deactivate(cfg->then_layer);
+            conditional_layer_deactivate(&layer_state, cfg->then_layer);
         }
     }
+
+    // This raises another event if anything changed, which re-runs the configs above against the
+    // new state. The process terminates once a pass changes nothing (at worst, when every layer is
+    // active).
+    zmk_keymap_layer_state_set(layer_state);
     return 0;
 }
 
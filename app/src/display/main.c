@@ -139,4 +139,4 @@ int display_event_handler(const zmk_event_t *eh) {
 }
 
 ZMK_LISTENER(display, display_event_handler);
-ZMK_SUBSCRIPTION(display, zmk_activity_state_changed);
+ZMK_SUBSCRIPTION_DEFERRED(display, zmk_activity_state_changed);
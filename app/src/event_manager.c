@@ -5,6 +5,7 @@
  */
 
 #include <zephyr.h>
+#include <sys/atomic.h>
 #include <logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -17,25 +18,276 @@ extern struct zmk_event_type *__event_type_end[];
 extern struct zmk_event_subscription __event_subscriptions_start[];
 extern struct zmk_event_subscription __event_subscriptions_end[];
 
+// Bit n is set while subscription n is disabled and skipped by dispatch. Subscriptions are indexed
+// with a uint8_t, so this covers all of them. Atomic, since listeners on other threads, like the
+// deferred ones, can enable and disable theirs while an event is being dispatched.
+static ATOMIC_DEFINE(disabled_subscriptions, UINT8_MAX + 1);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+
+static bool is_slab_block(const struct k_mem_slab *slab, const void *mem) {
+    const char *start = slab->buffer;
+    const char *end = start + slab->num_blocks * slab->block_size;
+    return (const char *)mem >= start && (const char *)mem < end;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+
+// Events are allocated, freed and raised from the deferred listener work queue as well as the
+// threads raising them, so all the counters are only updated under the lock.
+static struct zmk_event_manager_stats manager_stats;
+static struct k_spinlock manager_stats_lock;
+
+void zmk_event_manager_stats_get(struct zmk_event_manager_stats *stats) {
+    k_spinlock_key_t key = k_spin_lock(&manager_stats_lock);
+    *stats = manager_stats;
+    k_spin_unlock(&manager_stats_lock, key);
+}
+
+void zmk_event_manager_stats_reset_peaks() {
+    k_spinlock_key_t key = k_spin_lock(&manager_stats_lock);
+    manager_stats.peak_live_events = manager_stats.live_events;
+    manager_stats.peak_live_bytes = manager_stats.live_bytes;
+    k_spin_unlock(&manager_stats_lock, key);
+}
+
+static inline void stats_inc(uint32_t *counter) {
+    k_spinlock_key_t key = k_spin_lock(&manager_stats_lock);
+    (*counter)++;
+    k_spin_unlock(&manager_stats_lock, key);
+}
+
+#define STATS_INC(data, counter) stats_inc(&(data)->stats.counter)
+
+#else
+
+#define STATS_INC(data, counter)
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS) */
+
+static inline void stats_allocated(const struct zmk_event_type *type) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+    k_spinlock_key_t key = k_spin_lock(&manager_stats_lock);
+    manager_stats.live_events++;
+    manager_stats.live_bytes += type->size;
+    manager_stats.peak_live_events = MAX(manager_stats.peak_live_events, manager_stats.live_events);
+    manager_stats.peak_live_bytes = MAX(manager_stats.peak_live_bytes, manager_stats.live_bytes);
+    k_spin_unlock(&manager_stats_lock, key);
+#endif
+}
+
+static inline void stats_freed(const struct zmk_event_type *type) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_STATS)
+    k_spinlock_key_t key = k_spin_lock(&manager_stats_lock);
+    manager_stats.live_events--;
+    manager_stats.live_bytes -= type->size;
+    k_spin_unlock(&manager_stats_lock, key);
+#endif
+}
+
+static inline uint32_t trace_start(void) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    return k_cycle_get_32();
+#else
+    return 0;
+#endif
+}
+
+static inline void trace_callback(const struct zmk_event_subscription *ev_sub, uint32_t start) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    zmk_event_trace_record(&ev_sub->trace->callback, k_cycle_get_32() - start);
+#endif
+}
+
+static inline void trace_raised(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    // Captured events get re-raised, only the first raise counts.
+    if (event->raised_at == 0) {
+        event->raised_at = k_cycle_get_32();
+    }
+#endif
+}
+
+static inline void trace_captured(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    event->captured_at = k_cycle_get_32();
+#endif
+}
+
+static inline void trace_resumed(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    if (event->captured_at == 0) {
+        return;
+    }
+
+    // Charge the wait to the listener that captured the event.
+    struct zmk_event_subscription *ev_sub =
+        __event_subscriptions_start + event->last_listener_index;
+    zmk_event_trace_record(&ev_sub->trace->capture_wait, k_cycle_get_32() - event->captured_at);
+    event->captured_at = 0;
+#endif
+}
+
+static inline void trace_freed(zmk_event_t *event) {
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    if (event->raised_at != 0) {
+        zmk_event_trace_record(&event->event->data->lifetime, k_cycle_get_32() - event->raised_at);
+    }
+#endif
+}
+
+void *zmk_event_manager_alloc(const struct zmk_event_type *type) {
+    zmk_event_t *event = NULL;
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    if (k_mem_slab_alloc(type->slab, (void **)&event, K_NO_WAIT) != 0) {
+        event = NULL;
+        // Only warn on the first fallback so a long capture doesn't flood the log.
+        if (type->data->slab_fallbacks++ == 0) {
+            LOG_WRN("Event slab for %s exhausted, falling back to the heap. Consider increasing "
+                    "CONFIG_ZMK_EVENT_MANAGER_SLAB_BLOCKS",
+                    type->name);
+        }
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+    if (event == NULL) {
+        event = k_malloc(type->size);
+    }
+
+    if (event != NULL) {
+        stats_allocated(type);
+        event->last_listener_index = 0;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+        event->raised_at = 0;
+        event->captured_at = 0;
+#endif
+    }
+
+    return event;
+}
+
+void zmk_event_manager_free(zmk_event_t *event) {
+    stats_freed(event->event);
+    trace_freed(event);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+    struct k_mem_slab *slab = event->event->slab;
+    if (is_slab_block(slab, event)) {
+        k_mem_slab_free(slab, (void **)&event);
+        return;
+    }
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB) */
+
+    k_free(event);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED)
+
+K_THREAD_STACK_DEFINE(deferred_work_stack_area, CONFIG_ZMK_EVENT_MANAGER_DEFERRED_STACK_SIZE);
+
+static struct k_work_q deferred_work_q;
+
+// Copies of events waiting for their deferred listener, which is recorded in last_listener_index.
+K_MSGQ_DEFINE(deferred_msgq, sizeof(zmk_event_t *), CONFIG_ZMK_EVENT_MANAGER_DEFERRED_QUEUE_SIZE,
+              4);
+
+static void deliver_deferred(const zmk_event_t *event, uint8_t index) {
+    struct zmk_event_subscription *ev_sub = __event_subscriptions_start + index;
+    uint32_t trace_at = trace_start();
+    // Deferred listeners only observe events, so whatever they return is ignored.
+    ev_sub->listener->callback(event);
+    trace_callback(ev_sub, trace_at);
+}
+
+static void deferred_work_handler(struct k_work *work) {
+    zmk_event_t *event;
+
+    while (k_msgq_get(&deferred_msgq, &event, K_NO_WAIT) == 0) {
+        deliver_deferred(event, event->last_listener_index);
+        zmk_event_manager_free(event);
+    }
+}
+
+K_WORK_DEFINE(deferred_work, deferred_work_handler);
+
+static void defer_event(const zmk_event_t *event, uint8_t index) {
+    // When an event can't be deferred, the listener gets it right away instead, since display
+    // widgets and the like would otherwise stay out of date until their next event.
+    zmk_event_t *copy = zmk_event_manager_alloc(event->event);
+    if (copy == NULL) {
+        LOG_WRN("Unable to allocate a copy of %s, delivering it synchronously", event->event->name);
+        deliver_deferred(event, index);
+        return;
+    }
+
+    memcpy(copy, event, event->event->size);
+    copy->last_listener_index = index;
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_TRACE)
+    // The lifetime of the original event is the one that gets recorded.
+    copy->raised_at = 0;
+    copy->captured_at = 0;
+#endif
+
+    if (k_msgq_put(&deferred_msgq, &copy, K_NO_WAIT) != 0) {
+        LOG_WRN("Deferred event queue full, delivering %s synchronously", event->event->name);
+        deliver_deferred(copy, index);
+        zmk_event_manager_free(copy);
+        return;
+    }
+
+    k_work_submit_to_queue(&deferred_work_q, &deferred_work);
+}
+
+static inline bool is_deferred(const struct zmk_event_subscription *ev_sub) {
+    return ev_sub->deferred;
+}
+
+#else
+
+static inline void defer_event(const zmk_event_t *event, uint8_t index) {}
+
+static inline bool is_deferred(const struct zmk_event_subscription *ev_sub) { return false; }
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED) */
+
 int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
     int ret = 0;
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = start_index; i < len; i++) {
+    struct zmk_event_type_data *data = event->event->data;
+    uint8_t end = data->subscriptions_start + data->subscriptions_len;
+    trace_resumed(event);
+    for (int i = MAX(start_index, data->subscriptions_start); i < end; i++) {
+        if (atomic_test_bit(disabled_subscriptions, i)) {
+            continue;
+        }
+
         struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
-        if (ev_sub->event_type != event->event) {
+        if (is_deferred(ev_sub)) {
+            defer_event(event, i);
             continue;
         }
+
+        uint32_t trace_at = trace_start();
+        // Recorded before the callback so that a listener re-raising the event it is
+        // handling can be found without a search, see find_subscription_index.
+        event->last_listener_index = i;
         ret = ev_sub->listener->callback(event);
+        trace_callback(ev_sub, trace_at);
         switch (ret) {
         case ZMK_EV_EVENT_BUBBLE:
             continue;
         case ZMK_EV_EVENT_HANDLED:
             LOG_DBG("Listener handled the event");
+            STATS_INC(data, handled);
             ret = 0;
             goto release;
         case ZMK_EV_EVENT_CAPTURED:
             LOG_DBG("Listener captured the event");
+            STATS_INC(data, captured);
             event->last_listener_index = i;
+            trace_captured(event);
             // Listeners are expected to free events they capture
             return 0;
         default:
@@ -44,43 +296,124 @@ int zmk_event_manager_handle_from(zmk_event_t *event, uint8_t start_index) {
         }
     }
 
+    STATS_INC(data, bubbled);
+
 release:
-    k_free(event);
+    zmk_event_manager_free(event);
     return ret;
 }
 
-int zmk_event_manager_raise(zmk_event_t *event) { return zmk_event_manager_handle_from(event, 0); }
+int zmk_event_manager_raise(zmk_event_t *event) {
+    STATS_INC(event->event->data, raised);
+    trace_raised(event);
+    return zmk_event_manager_handle_from(event, 0);
+}
 
-int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
-    uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
-    for (int i = 0; i < len; i++) {
-        struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+static int find_type_subscription_index(const struct zmk_event_type *type,
+                                        const struct zmk_listener *listener) {
+    const struct zmk_event_type_data *data = type->data;
+    uint8_t end = data->subscriptions_start + data->subscriptions_len;
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i + 1);
+    for (int i = data->subscriptions_start; i < end; i++) {
+        if (__event_subscriptions_start[i].listener == listener) {
+            return i;
         }
     }
 
-    LOG_WRN("Unable to find where to raise this after event");
+    return -ENOENT;
+}
+
+static int find_subscription_index(const zmk_event_t *event, const struct zmk_listener *listener) {
+    struct zmk_event_type_data *data = event->event->data;
+    uint8_t end = data->subscriptions_start + data->subscriptions_len;
+
+    // Events are re-raised relative to a listener by the listener that is currently handling them,
+    // or by the one that captured them. Either way that is the subscription the event last
+    // visited, so check it before falling back to a search of the event type's listeners.
+    uint8_t last = event->last_listener_index;
+    if (last >= data->subscriptions_start && last < end &&
+        __event_subscriptions_start[last].listener == listener) {
+        return last;
+    }
+
+    return find_type_subscription_index(event->event, listener);
+}
+
+int zmk_event_manager_raise_after(zmk_event_t *event, const struct zmk_listener *listener) {
+    int index = find_subscription_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this after event");
+        return -EINVAL;
+    }
 
-    return -EINVAL;
+    return zmk_event_manager_handle_from(event, index + 1);
 }
 
 int zmk_event_manager_raise_at(zmk_event_t *event, const struct zmk_listener *listener) {
+    int index = find_subscription_index(event, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find where to raise this event");
+        return -EINVAL;
+    }
+
+    return zmk_event_manager_handle_from(event, index);
+}
+
+int zmk_event_manager_release(zmk_event_t *event) {
+    STATS_INC(event->event->data, released);
+    return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
+}
+
+int zmk_event_manager_subscription_set_enabled(const struct zmk_event_type *type,
+                                               const struct zmk_listener *listener, bool enabled) {
+    int index = find_type_subscription_index(type, listener);
+    if (index < 0) {
+        LOG_WRN("Unable to find the subscription to %s to change", type->name);
+        return -EINVAL;
+    }
+
+    if (enabled) {
+        atomic_clear_bit(disabled_subscriptions, index);
+    } else {
+        atomic_set_bit(disabled_subscriptions, index);
+    }
+    return 0;
+}
+
+static int zmk_event_manager_init(const struct device *_arg) {
     uint8_t len = __event_subscriptions_end - __event_subscriptions_start;
     for (int i = 0; i < len; i++) {
         struct zmk_event_subscription *ev_sub = __event_subscriptions_start + i;
+        struct zmk_event_type_data *data = ev_sub->event_type->data;
 
-        if (ev_sub->event_type == event->event && ev_sub->listener == listener) {
-            return zmk_event_manager_handle_from(event, i);
+        if (data->subscriptions_len == 0) {
+            data->subscriptions_start = i;
+        } else if (data->subscriptions_start + data->subscriptions_len != i) {
+            LOG_ERR("Subscriptions for %s are not contiguous", ev_sub->event_type->name);
+            return -EINVAL;
         }
-    }
 
-    LOG_WRN("Unable to find where to raise this event");
+        data->subscriptions_len++;
+    }
 
-    return -EINVAL;
+    return 0;
 }
 
-int zmk_event_manager_release(zmk_event_t *event) {
-    return zmk_event_manager_handle_from(event, event->last_listener_index + 1);
+SYS_INIT(zmk_event_manager_init, PRE_KERNEL_1, 0);
+
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED)
+
+static int zmk_event_manager_deferred_init(const struct device *_arg) {
+    static const struct k_work_queue_config queue_config = {.name = "Deferred Event Listeners"};
+    k_work_queue_start(&deferred_work_q, deferred_work_stack_area,
+                       K_THREAD_STACK_SIZEOF(deferred_work_stack_area),
+                       CONFIG_ZMK_EVENT_MANAGER_DEFERRED_PRIORITY, &queue_config);
+
+    // Deliver anything deferred before the queue was running.
+    k_work_submit_to_queue(&deferred_work_q, &deferred_work);
+    return 0;
 }
+
+SYS_INIT(zmk_event_manager_deferred_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
+#endif /* IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_DEFERRED) */
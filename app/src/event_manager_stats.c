@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/event_manager.h>
+#include <zmk/event_manager_print.h>
+
+extern struct zmk_event_type *__event_type_start[];
+extern struct zmk_event_type *__event_type_end[];
+
+static void stats_dump(const struct shell *sh) {
+    struct zmk_event_manager_stats manager_stats;
+    zmk_event_manager_stats_get(&manager_stats);
+
+    EM_PRINT(sh, "live events: %u (peak %u), live bytes: %zu (peak %zu)", manager_stats.live_events,
+             manager_stats.peak_live_events, manager_stats.live_bytes,
+             manager_stats.peak_live_bytes);
+
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        const struct zmk_event_type_stats *stats = &(*type)->data->stats;
+        if (stats->raised == 0) {
+            continue;
+        }
+
+        EM_PRINT(sh, "%s: raised %u bubbled %u handled %u captured %u released %u", (*type)->name,
+                 stats->raised, stats->bubbled, stats->handled, stats->captured, stats->released);
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+        if ((*type)->data->slab_fallbacks > 0) {
+            EM_PRINT(sh, "%s: %u heap fallbacks", (*type)->name, (*type)->data->slab_fallbacks);
+        }
+#endif
+    }
+}
+
+static void stats_reset() {
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        memset(&(*type)->data->stats, 0, sizeof(struct zmk_event_type_stats));
+#if IS_ENABLED(CONFIG_ZMK_EVENT_MANAGER_SLAB)
+        (*type)->data->slab_fallbacks = 0;
+#endif
+    }
+
+    zmk_event_manager_stats_reset_peaks();
+}
+
+#if IS_ENABLED(CONFIG_SHELL)
+
+static int cmd_stats_show(const struct shell *sh, size_t argc, char **argv) {
+    stats_dump(sh);
+    return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv) {
+    stats_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_event_stats,
+                               SHELL_CMD(show, NULL, "Show event counters", cmd_stats_show),
+                               SHELL_CMD(reset, NULL, "Clear event counters and peaks",
+                                         cmd_stats_reset),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(event_stats, &sub_event_stats, "Event manager statistics", NULL);
+
+#endif /* IS_ENABLED(CONFIG_SHELL) */
+
+#if CONFIG_ZMK_EVENT_MANAGER_STATS_LOG_INTERVAL > 0
+
+static void stats_log_work_handler(struct k_work *work) {
+    stats_dump(NULL);
+    k_work_schedule(k_work_delayable_from_work(work),
+                    K_SECONDS(CONFIG_ZMK_EVENT_MANAGER_STATS_LOG_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(stats_log_work, stats_log_work_handler);
+
+static int zmk_event_manager_stats_init(const struct device *_arg) {
+    k_work_schedule(&stats_log_work, K_SECONDS(CONFIG_ZMK_EVENT_MANAGER_STATS_LOG_INTERVAL));
+    return 0;
+}
+
+SYS_INIT(zmk_event_manager_stats_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* CONFIG_ZMK_EVENT_MANAGER_STATS_LOG_INTERVAL > 0 */
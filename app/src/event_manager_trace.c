@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zephyr.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/event_manager.h>
+#include <zmk/event_manager_print.h>
+
+extern struct zmk_event_type *__event_type_start[];
+extern struct zmk_event_type *__event_type_end[];
+
+extern struct zmk_event_subscription __event_subscriptions_start[];
+extern struct zmk_event_subscription __event_subscriptions_end[];
+
+void zmk_event_trace_record(struct zmk_event_trace_histogram *histogram, uint32_t cycles) {
+    uint32_t us = k_cyc_to_us_floor32(cycles);
+    uint8_t bucket = MIN(find_msb_set(us), ZMK_EVENT_TRACE_BUCKETS - 1);
+
+    histogram->buckets[bucket]++;
+}
+
+// Printed a bucket at a time with integer arguments, so nothing has to be formatted into a buffer
+// and copied into the log. Listener and event type names are string literals, which can be logged
+// without log_strdup.
+static void trace_print_histogram(const struct shell *sh, const char *listener, const char *type,
+                                  const char *kind,
+                                  const struct zmk_event_trace_histogram *histogram) {
+    const char *sep = listener != NULL ? "/" : "";
+    listener = listener != NULL ? listener : "";
+
+    for (int i = 0; i < ZMK_EVENT_TRACE_BUCKETS; i++) {
+        if (histogram->buckets[i] == 0) {
+            continue;
+        }
+
+        if (i == ZMK_EVENT_TRACE_BUCKETS - 1) {
+            EM_PRINT(sh, "%s%s%s %s: >=%luus:%u", listener, sep, type, kind, BIT(i - 1),
+                     histogram->buckets[i]);
+        } else {
+            EM_PRINT(sh, "%s%s%s %s: <%luus:%u", listener, sep, type, kind, BIT(i),
+                     histogram->buckets[i]);
+        }
+    }
+}
+
+static void trace_dump(const struct shell *sh) {
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        trace_print_histogram(sh, NULL, (*type)->name, "lifetime", &(*type)->data->lifetime);
+    }
+
+    for (struct zmk_event_subscription *ev_sub = __event_subscriptions_start;
+         ev_sub < __event_subscriptions_end; ev_sub++) {
+        const char *type = ev_sub->event_type->name;
+
+        trace_print_histogram(sh, ev_sub->listener_name, type, "callback",
+                              &ev_sub->trace->callback);
+        trace_print_histogram(sh, ev_sub->listener_name, type, "capture-wait",
+                              &ev_sub->trace->capture_wait);
+    }
+}
+
+static void trace_reset() {
+    for (struct zmk_event_type **type = __event_type_start; type < __event_type_end; type++) {
+        memset(&(*type)->data->lifetime, 0, sizeof(struct zmk_event_trace_histogram));
+    }
+
+    for (struct zmk_event_subscription *ev_sub = __event_subscriptions_start;
+         ev_sub < __event_subscriptions_end; ev_sub++) {
+        memset(ev_sub->trace, 0, sizeof(struct zmk_event_subscription_trace));
+    }
+}
+
+#if IS_ENABLED(CONFIG_SHELL)
+
+static int cmd_trace_show(const struct shell *sh, size_t argc, char **argv) {
+    trace_dump(sh);
+    return 0;
+}
+
+static int cmd_trace_reset(const struct shell *sh, size_t argc, char **argv) {
+    trace_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_event_trace,
+                               SHELL_CMD(show, NULL, "Show event latency histograms",
+                                         cmd_trace_show),
+                               SHELL_CMD(reset, NULL, "Clear event latency histograms",
+                                         cmd_trace_reset),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(event_trace, &sub_event_trace, "Event manager latency tracing", NULL);
+
+#endif /* IS_ENABLED(CONFIG_SHELL) */
+
+#if CONFIG_ZMK_EVENT_MANAGER_TRACE_LOG_INTERVAL > 0
+
+static void trace_log_work_handler(struct k_work *work) {
+    trace_dump(NULL);
+    k_work_schedule(k_work_delayable_from_work(work),
+                    K_SECONDS(CONFIG_ZMK_EVENT_MANAGER_TRACE_LOG_INTERVAL));
+}
+
+static K_WORK_DELAYABLE_DEFINE(trace_log_work, trace_log_work_handler);
+
+static int zmk_event_manager_trace_init(const struct device *_arg) {
+    k_work_schedule(&trace_log_work, K_SECONDS(CONFIG_ZMK_EVENT_MANAGER_TRACE_LOG_INTERVAL));
+    return 0;
+}
+
+SYS_INIT(zmk_event_manager_trace_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif /* CONFIG_ZMK_EVENT_MANAGER_TRACE_LOG_INTERVAL > 0 */
@@ -30,9 +30,7 @@ static uint8_t _zmk_keymap_layer_default = 0;
 
 #define DT_DRV_COMPAT zmk_keymap
 
-#define LAYER_CHILD_LEN(node) 1 +
 #define ZMK_KEYMAP_NODE DT_DRV_INST(0)
-#define ZMK_KEYMAP_LAYERS_LEN (DT_INST_FOREACH_CHILD(0, LAYER_CHILD_LEN) 0)
 
 #define BINDING_WITH_COMMA(idx, drv_inst) ZMK_KEYMAP_EXTRACT_BINDING(idx, drv_inst),
 
@@ -42,7 +40,8 @@ static uint8_t _zmk_keymap_layer_default = 0;
 #if ZMK_KEYMAP_HAS_SENSORS
 #define _TRANSFORM_SENSOR_ENTRY(idx, layer)                                                        \
     {                                                                                              \
-        .behavior_dev = DT_LABEL(DT_PHANDLE_BY_IDX(layer, sensor_bindings, idx)),                  \
+        .behavior_local_id =                                                                       \
+            ZMK_BEHAVIOR_LOCAL_ID(DT_PHANDLE_BY_IDX(layer, sensor_bindings, idx)),                 \
         .param1 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(layer, sensor_bindings, idx, param1), (0),    \
                               (DT_PHA_BY_IDX(layer, sensor_bindings, idx, param1))),               \
         .param2 = COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(layer, sensor_bindings, idx, param2), (0),    \
@@ -57,6 +56,18 @@ static uint8_t _zmk_keymap_layer_default = 0;
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+BUILD_ASSERT(ZMK_KEYMAP_LAYERS_LEN <= ZMK_KEYMAP_LAYERS_STATE_BITS,
+             "Keymap has more layers than the configured maximum number of keymap layers");
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_LAYER_STATE_64_BIT)
+// Logged in two halves, the default printf implementation has no 64 bit integers
+#define LAYER_STATE_FMT "0x%08X%08X"
+#define LAYER_STATE_ARG(state) (uint32_t)((state) >> 32), (uint32_t)(state)
+#else
+#define LAYER_STATE_FMT "0x%08X"
+#define LAYER_STATE_ARG(state) (uint32_t)(state)
+#endif
+
 #define LAYER_LABEL(node) COND_CODE_0(DT_NODE_HAS_PROP(node, label), (NULL), (DT_LABEL(node))),
 
 // State
@@ -64,22 +75,54 @@ static uint8_t _zmk_keymap_layer_default = 0;
 // When a behavior handles a key position "down" event, we record the layer state
 // here so that even if that layer is deactivated before the "up", event, we
 // still send the release event to the behavior in that layer also.
-static uint32_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+static zmk_keymap_layers_state_t zmk_keymap_active_behavior_layer[ZMK_KEYMAP_LEN];
+
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_CONST)
+
+static const struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
+    DT_INST_FOREACH_CHILD(0, TRANSFORMED_LAYER)};
+
+#else
 
 static struct zmk_behavior_binding zmk_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_LEN] = {
     DT_INST_FOREACH_CHILD(0, TRANSFORMED_LAYER)};
 
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_CONST) */
+
 static const char *zmk_keymap_layer_names[ZMK_KEYMAP_LAYERS_LEN] = {
     DT_INST_FOREACH_CHILD(0, LAYER_LABEL)};
 
+#define EFFECTIVE_LAYER_DIRTY UINT8_MAX
+
+// For each position, the highest active layer whose binding isn't &trans, so presses can start
+// there instead of walking down through transparent layers. Marked dirty whenever the layer state
+// changes, and found again the next time the position is used.
+static uint8_t zmk_keymap_effective_layer[ZMK_KEYMAP_LEN];
+
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_behavior_transparent)
+#define TRANSPARENT_LOCAL_ID ZMK_BEHAVIOR_LOCAL_ID(DT_INST(0, zmk_behavior_transparent))
+#else
+#define TRANSPARENT_LOCAL_ID ZMK_BEHAVIOR_LOCAL_ID_NONE
+#endif
+
 #if ZMK_KEYMAP_HAS_SENSORS
 
+#if IS_ENABLED(CONFIG_ZMK_KEYMAP_CONST)
+static const struct zmk_behavior_binding
+    zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN][ZMK_KEYMAP_SENSORS_LEN] = {
+        DT_INST_FOREACH_CHILD(0, SENSOR_LAYER)};
+#else
 static struct zmk_behavior_binding zmk_sensor_keymap[ZMK_KEYMAP_LAYERS_LEN]
                                                     [ZMK_KEYMAP_SENSORS_LEN] = {
                                                         DT_INST_FOREACH_CHILD(0, SENSOR_LAYER)};
+#endif /* IS_ENABLED(CONFIG_ZMK_KEYMAP_CONST) */
 
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+static inline void invalidate_effective_layers() {
+    memset(zmk_keymap_effective_layer, EFFECTIVE_LAYER_DIRTY, sizeof(zmk_keymap_effective_layer));
+}
+
 static inline int set_layer_state(uint8_t layer, bool state) {
     if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
         return -EINVAL;
@@ -91,11 +134,40 @@ static inline int set_layer_state(uint8_t layer, bool state) {
     }
 
     zmk_keymap_layers_state_t old_state = _zmk_keymap_layer_state;
-    WRITE_BIT(_zmk_keymap_layer_state, layer, state);
+    if (state) {
+        _zmk_keymap_layer_state |= ZMK_KEYMAP_LAYER_BIT(layer);
+    } else {
+        _zmk_keymap_layer_state &= ~ZMK_KEYMAP_LAYER_BIT(layer);
+    }
     // Don't send state changes unless there was an actual change
     if (old_state != _zmk_keymap_layer_state) {
         LOG_DBG("layer_changed: layer %d state %d", layer, state);
-        ZMK_EVENT_RAISE(create_layer_state_changed(layer, state));
+        invalidate_effective_layers();
+        ZMK_EVENT_RAISE(create_layer_state_changed(old_state, _zmk_keymap_layer_state));
+    }
+
+    return 0;
+}
+
+int zmk_keymap_layer_state_set(zmk_keymap_layers_state_t layer_state) {
+    // Wraps around to all bits set when the keymap uses every layer the state can hold
+    const zmk_keymap_layers_state_t keymap_layers =
+        (zmk_keymap_layers_state_t)(ZMK_KEYMAP_LAYER_BIT(ZMK_KEYMAP_LAYERS_LEN - 1) * 2 - 1);
+    if (layer_state & ~keymap_layers) {
+        return -EINVAL;
+    }
+
+    // Default layer should *always* remain active
+    layer_state |= _zmk_keymap_layer_state & ZMK_KEYMAP_LAYER_BIT(_zmk_keymap_layer_default);
+
+    zmk_keymap_layers_state_t old_state = _zmk_keymap_layer_state;
+    _zmk_keymap_layer_state = layer_state;
+    // All the layers change at once, so listeners see a single event for the whole transition
+    if (old_state != _zmk_keymap_layer_state) {
+        LOG_DBG("layer_changed: layer state " LAYER_STATE_FMT " to " LAYER_STATE_FMT,
+                LAYER_STATE_ARG(old_state), LAYER_STATE_ARG(layer_state));
+        invalidate_effective_layers();
+        ZMK_EVENT_RAISE(create_layer_state_changed(old_state, _zmk_keymap_layer_state));
     }
 
     return 0;
@@ -108,7 +180,7 @@ zmk_keymap_layers_state_t zmk_keymap_layer_state() { return _zmk_keymap_layer_st
 bool zmk_keymap_layer_active_with_state(uint8_t layer, zmk_keymap_layers_state_t state_to_test) {
     // The default layer is assumed to be ALWAYS ACTIVE so we include an || here to ensure nobody
     // breaks up that assumption by accident
-    return (state_to_test & (BIT(layer))) == (BIT(layer)) || layer == _zmk_keymap_layer_default;
+    return (state_to_test & ZMK_KEYMAP_LAYER_BIT(layer)) != 0 || layer == _zmk_keymap_layer_default;
 };
 
 bool zmk_keymap_layer_active(uint8_t layer) {
@@ -116,12 +188,8 @@ bool zmk_keymap_layer_active(uint8_t layer) {
 };
 
 uint8_t zmk_keymap_highest_layer_active() {
-    for (uint8_t layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer > 0; layer--) {
-        if (zmk_keymap_layer_active(layer)) {
-            return layer;
-        }
-    }
-    return zmk_keymap_layer_default();
+    return zmk_keymap_layers_state_highest(_zmk_keymap_layer_state |
+                                           ZMK_KEYMAP_LAYER_BIT(_zmk_keymap_layer_default));
 }
 
 int zmk_keymap_layer_activate(uint8_t layer) { return set_layer_state(layer, true); };
@@ -137,17 +205,15 @@ int zmk_keymap_layer_toggle(uint8_t layer) {
 };
 
 int zmk_keymap_layer_to(uint8_t layer) {
-    for (int i = ZMK_KEYMAP_LAYERS_LEN - 1; i >= 0; i--) {
-        zmk_keymap_layer_deactivate(i);
+    if (layer >= ZMK_KEYMAP_LAYERS_LEN) {
+        return -EINVAL;
     }
 
-    zmk_keymap_layer_activate(layer);
-
-    return 0;
+    return zmk_keymap_layer_state_set(ZMK_KEYMAP_LAYER_BIT(layer));
 }
 
 bool is_active_layer(uint8_t layer, zmk_keymap_layers_state_t layer_state) {
-    return (layer_state & BIT(layer)) == BIT(layer) || layer == _zmk_keymap_layer_default;
+    return (layer_state & ZMK_KEYMAP_LAYER_BIT(layer)) != 0 || layer == _zmk_keymap_layer_default;
 }
 
 const char *zmk_keymap_layer_label(uint8_t layer) {
@@ -158,12 +224,16 @@ const char *zmk_keymap_layer_label(uint8_t layer) {
     return zmk_keymap_layer_names[layer];
 }
 
-int invoke_locally(struct zmk_behavior_binding *binding, struct zmk_behavior_binding_event event,
-                   bool pressed) {
+static const struct zmk_behavior_binding *get_binding(uint8_t layer, uint32_t position) {
+    return &zmk_keymap[layer][position];
+}
+
+int invoke_locally(const struct device *behavior, struct zmk_behavior_binding *binding,
+                   struct zmk_behavior_binding_event event, bool pressed) {
     if (pressed) {
-        return behavior_keymap_binding_pressed(binding, event);
+        return behavior_device_binding_pressed(behavior, binding, event);
     } else {
-        return behavior_keymap_binding_released(binding, event);
+        return behavior_device_binding_released(behavior, binding, event);
     }
 }
 
@@ -171,25 +241,22 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
                                     int64_t timestamp) {
     // We want to make a copy of this, since it may be converted from
     // relative to absolute before being invoked
-    struct zmk_behavior_binding binding = zmk_keymap[layer][position];
-    const struct device *behavior;
+    struct zmk_behavior_binding binding = *get_binding(layer, position);
+    const struct device *behavior = zmk_behavior_get_by_local_id(binding.behavior_local_id);
     struct zmk_behavior_binding_event event = {
         .layer = layer,
         .position = position,
         .timestamp = timestamp,
     };
 
-    LOG_DBG("layer: %d position: %d, binding name: %s", layer, position,
-            log_strdup(binding.behavior_dev));
-
-    behavior = device_get_binding(binding.behavior_dev);
-
     if (!behavior) {
         LOG_WRN("No behavior assigned to %d on layer %d", position, layer);
         return 1;
     }
 
-    int err = behavior_keymap_binding_convert_central_state_dependent_params(&binding, event);
+    LOG_DBG("layer: %d position: %d, binding name: %s", layer, position, behavior->name);
+
+    int err = behavior_device_convert_central_state_dependent_params(behavior, &binding, event);
     if (err) {
         LOG_ERR("Failed to convert relative to absolute behavior binding (err %d)", err);
         return err;
@@ -204,16 +271,16 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
 
     switch (locality) {
     case BEHAVIOR_LOCALITY_CENTRAL:
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(behavior, &binding, event, pressed);
     case BEHAVIOR_LOCALITY_EVENT_SOURCE:
 #if ZMK_BLE_IS_CENTRAL
         if (source == ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL) {
-            return invoke_locally(&binding, event, pressed);
+            return invoke_locally(behavior, &binding, event, pressed);
         } else {
             return zmk_split_bt_invoke_behavior(source, &binding, event, pressed);
         }
 #else
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(behavior, &binding, event, pressed);
 #endif
     case BEHAVIOR_LOCALITY_GLOBAL:
 #if ZMK_BLE_IS_CENTRAL
@@ -221,18 +288,53 @@ int zmk_keymap_apply_position_state(uint8_t source, int layer, uint32_t position
             zmk_split_bt_invoke_behavior(i, &binding, event, pressed);
         }
 #endif
-        return invoke_locally(&binding, event, pressed);
+        return invoke_locally(behavior, &binding, event, pressed);
     }
 
     return -ENOTSUP;
 }
 
+static uint8_t effective_layer(uint32_t position) {
+    if (zmk_keymap_effective_layer[position] != EFFECTIVE_LAYER_DIRTY) {
+        return zmk_keymap_effective_layer[position];
+    }
+
+    uint8_t layer = ZMK_KEYMAP_LAYERS_LEN - 1;
+    for (; layer > _zmk_keymap_layer_default; layer--) {
+        if (zmk_keymap_layer_active(layer) &&
+            get_binding(layer, position)->behavior_local_id != TRANSPARENT_LOCAL_ID) {
+            break;
+        }
+    }
+
+    zmk_keymap_effective_layer[position] = layer;
+    return layer;
+}
+
+const struct zmk_behavior_binding *zmk_keymap_position_binding(uint32_t position,
+                                                               const struct device **behavior) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        return NULL;
+    }
+
+    const struct zmk_behavior_binding *binding = get_binding(effective_layer(position), position);
+    *behavior = zmk_behavior_get_by_local_id(binding->behavior_local_id);
+    return binding;
+}
+
 int zmk_keymap_position_state_changed(uint8_t source, uint32_t position, bool pressed,
                                       int64_t timestamp) {
     if (pressed) {
         zmk_keymap_active_behavior_layer[position] = _zmk_keymap_layer_state;
     }
-    for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
+
+    int layer = ZMK_KEYMAP_LAYERS_LEN - 1;
+    // Releases after a layer change have to look at the layers as they were when pressed.
+    if (zmk_keymap_active_behavior_layer[position] == _zmk_keymap_layer_state) {
+        layer = effective_layer(position);
+    }
+
+    for (; layer >= _zmk_keymap_layer_default; layer--) {
         if (zmk_keymap_layer_active_with_state(layer, zmk_keymap_active_behavior_layer[position])) {
             int ret = zmk_keymap_apply_position_state(source, layer, position, pressed, timestamp);
             if (ret > 0) {
@@ -255,21 +357,19 @@ int zmk_keymap_sensor_triggered(uint8_t sensor_number, const struct device *sens
                                 int64_t timestamp) {
     for (int layer = ZMK_KEYMAP_LAYERS_LEN - 1; layer >= _zmk_keymap_layer_default; layer--) {
         if (zmk_keymap_layer_active(layer) && zmk_sensor_keymap[layer] != NULL) {
-            struct zmk_behavior_binding *binding = &zmk_sensor_keymap[layer][sensor_number];
-            const struct device *behavior;
+            struct zmk_behavior_binding binding = zmk_sensor_keymap[layer][sensor_number];
+            const struct device *behavior = zmk_behavior_get_by_local_id(binding.behavior_local_id);
             int ret;
 
-            LOG_DBG("layer: %d sensor_number: %d, binding name: %s", layer, sensor_number,
-                    log_strdup(binding->behavior_dev));
-
-            behavior = device_get_binding(binding->behavior_dev);
-
             if (!behavior) {
                 LOG_DBG("No behavior assigned to %d on layer %d", sensor_number, layer);
                 continue;
             }
 
-            ret = behavior_sensor_keymap_binding_triggered(binding, sensor, timestamp);
+            LOG_DBG("layer: %d sensor_number: %d, binding name: %s", layer, sensor_number,
+                    behavior->name);
+
+            ret = behavior_device_sensor_binding_triggered(behavior, &binding, sensor, timestamp);
 
             if (ret > 0) {
                 LOG_DBG("behavior processing to continue to next layer");
@@ -306,6 +406,14 @@ int keymap_listener(const zmk_event_t *eh) {
     return -ENOTSUP;
 }
 
+static int zmk_keymap_init(const struct device *_arg) {
+    invalidate_effective_layers();
+
+    return 0;
+}
+
+SYS_INIT(zmk_keymap_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
 ZMK_LISTENER(keymap, keymap_listener);
 ZMK_SUBSCRIPTION(keymap, zmk_position_state_changed);
 
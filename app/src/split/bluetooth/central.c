@@ -553,18 +553,16 @@ split_bt_invoke_behavior_payload(struct zmk_split_run_behavior_payload_wrapper p
 
 int zmk_split_bt_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
                                  struct zmk_behavior_binding_event event, bool state) {
-    struct zmk_split_run_behavior_payload payload = {.data = {
-                                                         .param1 = binding->param1,
-                                                         .param2 = binding->param2,
-                                                         .position = event.position,
-                                                         .state = state ? 1 : 0,
-                                                     }};
-    const size_t payload_dev_size = sizeof(payload.behavior_dev);
-    if (strlcpy(payload.behavior_dev, binding->behavior_dev, payload_dev_size) >=
-        payload_dev_size) {
-        LOG_ERR("Truncated behavior label %s to %s before invoking peripheral behavior",
-                log_strdup(binding->behavior_dev), log_strdup(payload.behavior_dev));
-    }
+    struct zmk_split_run_behavior_payload payload = {
+        .data =
+            {
+                .param1 = binding->param1,
+                .param2 = binding->param2,
+                .position = event.position,
+                .state = state ? 1 : 0,
+            },
+        .behavior_local_id = binding->behavior_local_id,
+    };
 
     struct zmk_split_run_behavior_payload_wrapper wrapper = {.source = source, .payload = payload};
     return split_bt_invoke_behavior_payload(wrapper);
@@ -46,33 +46,34 @@ static ssize_t split_svc_run_behavior(struct bt_conn *conn, const struct bt_gatt
         return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
     }
 
-    memcpy(payload + offset, buf, len);
-
-    // We run if:
-    // 1: We've gotten all the position/state/param data.
-    // 2: We have a null terminated string for the behavior device label.
-    const size_t behavior_dev_offset =
-        offsetof(struct zmk_split_run_behavior_payload, behavior_dev);
-    if ((end_addr > sizeof(struct zmk_split_run_behavior_data)) &&
-        payload->behavior_dev[end_addr - behavior_dev_offset - 1] == '\0') {
+    memcpy((uint8_t *)payload + offset, buf, len);
+
+    // We run once we've gotten the whole payload, the behavior local ID being last.
+    if (end_addr == sizeof(struct zmk_split_run_behavior_payload)) {
+        const struct device *behavior = zmk_behavior_get_by_local_id(payload->behavior_local_id);
+        if (behavior == NULL) {
+            LOG_ERR("No behavior with local ID 0x%04x", payload->behavior_local_id);
+            return len;
+        }
+
         struct zmk_behavior_binding binding = {
             .param1 = payload->data.param1,
             .param2 = payload->data.param2,
-            .behavior_dev = payload->behavior_dev,
+            .behavior_local_id = payload->behavior_local_id,
         };
-        LOG_DBG("%s with params %d %d: pressed? %d", log_strdup(binding.behavior_dev),
-                binding.param1, binding.param2, payload->data.state);
+        LOG_DBG("%s with params %d %d: pressed? %d", behavior->name, binding.param1, binding.param2,
+                payload->data.state);
         struct zmk_behavior_binding_event event = {.position = payload->data.position,
                                                    .timestamp = k_uptime_get()};
         int err;
         if (payload->data.state > 0) {
-            err = behavior_keymap_binding_pressed(&binding, event);
+            err = behavior_device_binding_pressed(behavior, &binding, event);
         } else {
-            err = behavior_keymap_binding_released(&binding, event);
+            err = behavior_device_binding_released(behavior, &binding, event);
         }
 
         if (err) {
-            LOG_ERR("Failed to invoke behavior %s: %d", log_strdup(binding.behavior_dev), err);
+            LOG_ERR("Failed to invoke behavior %s: %d", behavior->name, err);
         }
     }
 
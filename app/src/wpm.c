@@ -30,7 +30,8 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 static uint8_t wpm_state = -1;
 static uint8_t last_wpm_state;
 static uint8_t wpm_update_counter;
-static uint32_t key_pressed_count;
+// Counted from the deferred listener queue and reset from the system work queue.
+static atomic_t key_pressed_count;
 
 int zmk_wpm_get_state() { return wpm_state; }
 
@@ -39,8 +40,9 @@ int wpm_event_listener(const zmk_event_t *eh) {
     if (ev) {
         // count only key up events
         if (!ev->state) {
-            key_pressed_count++;
-            LOG_DBG("key_pressed_count %d keycode %d", key_pressed_count, ev->keycode);
+            atomic_inc(&key_pressed_count);
+            LOG_DBG("key_pressed_count %d keycode %d", atomic_get(&key_pressed_count),
+                    ev->keycode);
         }
     }
     return 0;
@@ -48,7 +50,7 @@ int wpm_event_listener(const zmk_event_t *eh) {
 
 void wpm_work_handler(struct k_work *work) {
     wpm_update_counter++;
-    wpm_state = (key_pressed_count / CHARS_PER_WORD) /
+    wpm_state = (atomic_get(&key_pressed_count) / CHARS_PER_WORD) /
                 (wpm_update_counter * WPM_UPDATE_INTERVAL_SECONDS / 60.0);
 
     if (last_wpm_state != wpm_state) {
@@ -62,7 +64,7 @@ void wpm_work_handler(struct k_work *work) {
 
     if (wpm_update_counter >= WPM_RESET_INTERVAL_SECONDS) {
         wpm_update_counter = 0;
-        key_pressed_count = 0;
+        atomic_set(&key_pressed_count, 0);
     }
 }
 
@@ -81,6 +83,6 @@ int wpm_init() {
 }
 
 ZMK_LISTENER(wpm, wpm_event_listener);
-ZMK_SUBSCRIPTION(wpm, zmk_keycode_state_changed);
+ZMK_SUBSCRIPTION_DEFERRED(wpm, zmk_keycode_state_changed);
 
 SYS_INIT(wpm_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);